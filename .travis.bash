@@ -12,15 +12,15 @@ bash setup_libs.bash
 # build spdlog 
 make deps
 
-# build 3 binaries (plain, avx, avx2)
+# build the release binary
 ./build_release.sh
 
 file aquachain-miner*
 file aquachain-miner/*
-aquachain-miner/aquachain-miner-*plain -h
+aquachain-miner/aquachain-miner-* -h
 
 # make sure it can hash without illegal instruction
-#aquachain-miner/aquachain-miner-*plain -B 
+#aquachain-miner/aquachain-miner-* -B 
 
 #mkdir build && cd build && cmake .. && make -j8 && file aquachain-miner*
 
@@ -3,14 +3,8 @@ mkdir aquachain-miner # should not exist
 # clean everything
 make clean && make -C aquahash clean
 
-# build each, copy to folder and clean afterwards
-make -j 4 config=avx2
-mv bin/* aquachain-miner/
-make clean && make -C aquahash clean
-make -j 4 config=plain
-mv bin/* aquachain-miner/
-make clean && make -C aquahash clean
-make -j 4 config=avx
+# one binary for every x86-64 cpu, the hashing kernel is picked at startup
+make -j 4
 mv bin/* aquachain-miner/
 make clean && make -C aquahash clean
 
@@ -21,32 +21,61 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <vector>
+#define HASH_LEN (32)
+#define HASH_INPUT_LEN (40)
 static const unsigned char hex_digits[] = {'0', '1', '2', '3', '4', '5',
                                            '6', '7', '8', '9', 'A', 'B',
                                            'C', 'D', 'E', 'F'};
-void mpz_maxBest(mpz_t mpz_n);
-int char2int(char input);
 void __bin2hex(char *s, const unsigned char *p, size_t len);
 char *bin2hex(const unsigned char *p, size_t len);
-void hex2bin(const char *src, uint8_t *target);
+// hex into bytes, false if it isn't all hex digits. hex0x2bin skips a 0x.
+bool hex2bin(const char *src, uint8_t *target);
 void print_hex(const unsigned char *src, size_t len);
 void to_hex(const unsigned char *src, char *target, size_t len);
-void mpz_maxBest(mpz_t mpz_n);
-void hex0x2bin(const char *src, uint8_t *target);
+bool hex0x2bin(const char *src, uint8_t *target);
 void mpz_fromBytesNoInit(uint8_t *bytes, size_t count, mpz_t mpz_result);
 
 void mpz_fromBytes(uint8_t *bytes, size_t count, mpz_t mpz_result);
-void decodeHex(const char *encoded, mpz_t mpz_res);
+// 0x hex into an initialized mpz, reusing its storage. False (and 0) if
+// it isn't hex.
+bool decodeHex(const char *encoded, mpz_t mpz_res);
 std::string decodeHex(const std::string &encoded);
 
 void encodeHex(mpz_t mpz_num, std::string &res);
-// target = 2 ^ 256 / difficulty
-void computeTarget(mpz_t mpz_difficulty, mpz_t &mpz_target);
-// difficulty = 2 ^ 256 / target
-void computeDifficulty(mpz_t mpz_target, mpz_t &mpz_difficulty);
 std::string mpzToString(mpz_t num);
+
+// target as four 64-bit words, most significant first (saturates at 2^256-1)
+void targetToWords(mpz_t mpz_target, uint64_t words[4]);
+// and back, into an initialized mpz
+void wordsToTarget(const uint64_t words[4], mpz_t mpz_target);
+
+// read 8 big endian bytes
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t w;
+  memcpy(&w, p, 8);
+  return __builtin_bswap64(w);
+}
+
+// true if the 32 byte big endian hash is <= target (what mpz_cmp checks).
+// the top word decides all but ~2^-64 of hashes, so that is the only branch
+// taken on the hot path.
+static inline bool hashMeetsTarget(const uint8_t *hash,
+                                   const uint64_t target[4]) {
+  uint64_t h = load_be64(hash);
+  if (h != target[0]) {
+    return h < target[0];
+  }
+  for (int i = 1; i < 4; i++) {
+    h = load_be64(hash + 8 * i);
+    if (h != target[i]) {
+      return h < target[i];
+    }
+  }
+  return true;
+}
 typedef unsigned char byte;
 typedef std::vector<byte> Bytes;
 
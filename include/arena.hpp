@@ -0,0 +1,78 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_ARENA_H
+#define M_ARENA_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_PAGE (4096)  // arena alignment, also a whole number of lines
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)  // x86-64 huge page, --hugepages
+
+// what backs an arena
+enum ArenaPages {
+  ARENA_PAGES_NORMAL,
+  ARENA_PAGES_THP,      // madvise(MADV_HUGEPAGE), transparent huge pages
+  ARENA_PAGES_HUGETLB,  // MAP_HUGETLB, from the reserved huge page pool
+};
+const char *arena_pages_name(ArenaPages pages);
+
+// back arenas reserved from now on with 2 MiB huge pages: reserved ones if
+// the system has any, else transparent ones, else normal pages. A whole
+// arena then sits in one TLB entry instead of up to 64.
+void arena_use_hugepages(bool on);
+bool arena_hugepages();
+
+// bytes of block memory argon2 asks for at a given m_cost (KiB).
+// argon2 never uses less than 8 blocks, and rounds down to 4 block slices.
+inline size_t aquahash_memsize(uint32_t mem) {
+  if (mem < 8) mem = 8;
+  return static_cast<size_t>(mem / 4 * 4) * 1024;
+}
+
+// HashArena is one thread's argon2 working memory. It is handed to
+// libaquahash through the allocate_cbk/free_cbk hooks so that hashing a nonce
+// never touches the heap. It only grows, and only when asked for more.
+// Reserve it from the thread that hashes in it, its pages go on that
+// thread's NUMA node.
+class HashArena {
+ public:
+  HashArena();
+  ~HashArena();
+  // make sure at least `bytes` are available, returns false if out of memory
+  bool reserve(size_t bytes);
+  uint8_t *data() { return mem; }
+  size_t size() const { return cap; }
+  ArenaPages pages() const { return mode; }
+  // use this arena for aquahash_version() calls made by this thread
+  void bind();
+  void unbind();
+  static HashArena *current();
+
+ private:
+  HashArena(const HashArena &);
+  HashArena &operator=(const HashArena &);
+  uint8_t *mem;
+  size_t cap;
+  ArenaPages mode;
+};
+
+// argon2 allocator callbacks, serving from the calling thread's arena
+int arena_allocate(uint8_t **memory, size_t bytes_to_allocate);
+void arena_deallocate(uint8_t *memory, size_t bytes_to_allocate);
+
+#endif  // M_ARENA_H
@@ -0,0 +1,52 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_AUTOTUNE_H
+#define M_AUTOTUNE_H
+#include <string>
+
+// tune at aquahash v4 (32 KiB per hash), the version that leans on the
+// caches hardest
+#define AUTOTUNE_VERSION (4)
+// seconds per calibration trial, a full tune takes a few dozen of them
+#define AUTOTUNE_SECONDS (0.3)
+
+// TuneResult is the fastest way found to mine on one kind of host
+struct TuneResult {
+  std::string kernel;
+  int threads;
+  std::string pinning;
+  int batch;    // nonces per call, in kernel widths
+  double rate;  // hashes per second it measured
+};
+
+// cache entries are per cpu model and cpu count
+std::string autotuneKey();
+// $XDG_CACHE_HOME/aquaminer/autotune.json, or under ~/.cache
+std::string autotuneCachePath();
+// the cached result for `key`, false if there is none
+bool autotuneLoad(const std::string &path, const std::string &key,
+                  TuneResult *out);
+// add or replace the result for `key`, keeping the other hosts' entries
+bool autotuneSave(const std::string &path, const std::string &key,
+                  const TuneResult &result);
+// short calibration sweeps over the bench engine: kernel, then thread
+// count, then pinning, then batch size. Takes `seconds` per trial. Leaves
+// the best kernel selected, or "auto" and an empty kernel if none passed
+// its selftest.
+TuneResult autotune(double seconds);
+
+#endif  // M_AUTOTUNE_H
@@ -0,0 +1,68 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_BENCH_H
+#define M_BENCH_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// kernel name --bench-suite uses for one libaquahash call per nonce
+#define BENCH_REFERENCE "reference"
+
+// BenchConfig is what --bench-suite sweeps: every combination of aquahash
+// version, kernel, batch size and thread count, each warmed up and then
+// timed `trials` times
+struct BenchConfig {
+  std::vector<int> versions;  // aquahash versions, 2 3 4
+  std::vector<std::string> kernels;
+  std::vector<int> batches;  // nonces per call, in kernel widths
+  std::vector<int> threads;
+  int trials;
+  double seconds;  // per trial
+  double warmup;   // seconds, not measured
+  std::string format;  // text, json or csv
+  bool hugepages;      // also time every combination on huge pages
+};
+
+// BenchResult is one combination, rates are hashes per second per trial
+// and latencies are microseconds per hash, one per call
+struct BenchResult {
+  int version;
+  std::string kernel;
+  size_t batch;  // nonces per call
+  int threads;
+  std::string pinning;  // --pin policy, PIN_NONE or one of the others
+  std::string pages;    // what backed the arenas, arena_pages_name()
+  std::vector<double> rates;
+  std::vector<double> latencies;
+  std::vector<double> dtlbMisses;  // per hash per trial, empty without perf
+};
+
+// comma separated numbers, false if any of them isn't one
+bool parseBenchList(const std::string &list, std::vector<int> *out);
+// median hashes per second of `job` (kernel already selected) over
+// `trials` runs of `seconds`, after `warmup` seconds not measured
+double benchRate(BenchResult *job, double warmup, double seconds, int trials);
+// run the sweep, print the results to stdout in cfg.format. Returns the
+// process exit code.
+int runBenchSuite(const BenchConfig &cfg);
+// "model name" from /proc/cpuinfo, "unknown" if there is none
+std::string cpuModel();
+
+#endif  // M_BENCH_H
@@ -0,0 +1,80 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_ENGINE_H
+#define M_ENGINE_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// most nonces one kernel hashes side by side (one per 64-bit SIMD lane)
+#define AQUAHASH_MAX_LANES (8)
+
+// Batched aquahash: argon2id with Aquachain's fixed parameters (t_cost=1,
+// 1 lane, 40 byte input, 32 byte output, no salt), hashing several inputs
+// at once. Every BLAKE2b and block compression step works on one 64-bit
+// word of each input per SIMD lane, so independent hashes hide each other's
+// dependency latency without any shuffling.
+//
+// hashes `count` inputs (HASH_INPUT_LEN bytes each, back to back) into
+// `out` (HASH_LEN bytes each). `memory` must be 64 byte aligned and hold
+// aquahash_batch_memsize(mem) bytes. Returns ARGON2_OK.
+int aquahash_batch(uint8_t *out, const uint8_t *in, size_t count,
+                   uint32_t mem, void *memory);
+
+// What one job's H0 hashing has in common for every nonce: the BLAKE2b
+// message words without the nonce, and the state after the G steps that
+// don't depend on it. Take it once per job with aquahash_midstate().
+struct AquahashMidstate;
+typedef void (*AquahashNoncesFn)(uint8_t *out, const AquahashMidstate &mid,
+                                 uint64_t nonce, void *memory);
+struct AquahashMidstate {
+  uint32_t mem;
+  uint64_t m[16];
+  uint64_t v[16];
+  // kernels built for this m_cost: `width` nonces per call, and one nonce
+  // per call for the leftovers
+  size_t width;
+  AquahashNoncesFn hash;
+  AquahashNoncesFn hashOne;
+};
+// midstate for the 32 byte header `prefix` at m_cost `mem`, with the
+// current kernel's code for that m_cost
+void aquahash_midstate(AquahashMidstate *mid, const uint8_t *prefix,
+                       uint32_t mem);
+// aquahash_batch for the inputs prefix || LE64(nonce + i), i < count,
+// finishing H0 from the midstate. Same output as aquahash_batch.
+int aquahash_batch_nonces(uint8_t *out, const AquahashMidstate &mid,
+                          uint64_t nonce, size_t count, void *memory);
+// bytes of working memory aquahash_batch needs at this m_cost
+size_t aquahash_batch_memsize(uint32_t mem);
+// nonces per aquahash_batch call the miner should use on this cpu
+size_t aquahash_batch_width();
+// name of the kernel in use (generic, sse2, avx2, avx512)
+const char *aquahash_batch_isa();
+// use the named kernel instead of the one picked from cpuid, "auto" goes
+// back to picking. Returns false if it is unknown or this cpu can't run it.
+// Call before any hashing starts.
+bool aquahash_batch_select(const std::string &name);
+// space separated kernels this cpu can run, widest first
+std::string aquahash_batch_kernels();
+// compare aquahash_batch and aquahash_batch_nonces against libaquahash for
+// every version, all lanes
+bool aquahash_batch_selftest();
+
+#endif  // M_ENGINE_H
@@ -0,0 +1,406 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Lane-generic aquahash kernel: BLAKE2b, the argon2 block compression and
+// batch_hash<V>, written against a lane type V (see src/engine.cpp).
+//
+// No include guard on purpose. src/engine.cpp includes this once per
+// instruction set, each time inside its own namespace and `#pragma GCC
+// target` region, so every copy is compiled for that instruction set only
+// and none of them can be merged with another at link time.
+//
+// Needs from the including file: FORCE_INLINE, ARGON2_QWORDS,
+// ARGON2_SLICES, blake2b_IV, blake2b_sigma, memory_blocks, index_alpha,
+// independent_refs and h0_message.
+
+// BLAKE2b, for the same length message in every lane
+
+// G in two halves, each mixing in one message word
+template <class V>
+FORCE_INLINE void blake2b_g1(typename V::reg &a, typename V::reg &b,
+                             typename V::reg &c, typename V::reg &d,
+                             typename V::reg x) {
+  a = V::add(V::add(a, b), x);
+  d = V::rotr32(V::xor_(d, a));
+  c = V::add(c, d);
+  b = V::rotr24(V::xor_(b, c));
+}
+
+template <class V>
+FORCE_INLINE void blake2b_g2(typename V::reg &a, typename V::reg &b,
+                             typename V::reg &c, typename V::reg &d,
+                             typename V::reg y) {
+  a = V::add(V::add(a, b), y);
+  d = V::rotr16(V::xor_(d, a));
+  c = V::add(c, d);
+  b = V::rotr63(V::xor_(b, c));
+}
+
+template <class V>
+FORCE_INLINE void blake2b_g(typename V::reg &a, typename V::reg &b,
+                            typename V::reg &c, typename V::reg &d,
+                            typename V::reg x, typename V::reg y) {
+  blake2b_g1<V>(a, b, c, d, x);
+  blake2b_g2<V>(a, b, c, d, y);
+}
+
+template <class V>
+FORCE_INLINE void blake2b_init(typename V::reg h[8], uint32_t outlen) {
+  for (int i = 0; i < 8; i++) {
+    h[i] = V::set1(blake2b_IV[i]);
+  }
+  h[0] = V::xor_(h[0], V::set1(0x01010000ULL ^ outlen));
+}
+
+// the working state for compressing a block, t is the byte count so far
+// including it
+template <class V>
+FORCE_INLINE void blake2b_state(typename V::reg v[16],
+                                const typename V::reg h[8], uint64_t t,
+                                bool last) {
+  for (int i = 0; i < 8; i++) {
+    v[i] = h[i];
+    v[i + 8] = V::set1(blake2b_IV[i]);
+  }
+  v[12] = V::set1(blake2b_IV[4] ^ t);
+  if (last) {
+    v[14] = V::set1(~blake2b_IV[6]);
+  }
+}
+
+// the last 4 G steps of round r
+template <class V>
+FORCE_INLINE void blake2b_diagonals(typename V::reg v[16],
+                                    const typename V::reg m[16], int r) {
+  const uint8_t *s = blake2b_sigma[r];
+  blake2b_g<V>(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+  blake2b_g<V>(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+  blake2b_g<V>(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+  blake2b_g<V>(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+}
+
+// rounds `from` to 11
+template <class V>
+FORCE_INLINE void blake2b_rounds(typename V::reg v[16],
+                                 const typename V::reg m[16], int from) {
+  for (int r = from; r < 12; r++) {
+    const uint8_t *s = blake2b_sigma[r];
+    blake2b_g<V>(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+    blake2b_g<V>(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+    blake2b_g<V>(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+    blake2b_g<V>(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+    blake2b_diagonals<V>(v, m, r);
+  }
+}
+
+template <class V>
+FORCE_INLINE void blake2b_finish(typename V::reg h[8],
+                                 const typename V::reg v[16]) {
+  for (int i = 0; i < 8; i++) {
+    h[i] = V::xor_(h[i], V::xor_(v[i], v[i + 8]));
+  }
+}
+
+// compress one 128 byte block, t is the byte count so far including it
+template <class V>
+FORCE_INLINE void blake2b_compress(typename V::reg h[8],
+                                   const typename V::reg m[16], uint64_t t,
+                                   bool last) {
+  typename V::reg v[16];
+  blake2b_state<V>(v, h, t, last);
+  blake2b_rounds<V>(v, m, 0);
+  blake2b_finish<V>(h, v);
+}
+
+// H0 midstate. The H0 message is the argon2 parameters, the 32 byte header
+// and the nonce, and only words 7 (high half) and 8 (low half) hold nonce
+// bytes. In round 0 the first three G steps and the first half of the
+// fourth mix in words 0 to 6 only, so they are done once per job here,
+// and finished per nonce by h0_from_midstate().
+template <class V>
+void h0_midstate(typename V::reg v[16], const typename V::reg m[16]) {
+  typename V::reg h[8];
+  blake2b_init<V>(h, 64);
+  blake2b_state<V>(v, h, 80, true);
+  blake2b_g<V>(v[0], v[4], v[8], v[12], m[0], m[1]);
+  blake2b_g<V>(v[1], v[5], v[9], v[13], m[2], m[3]);
+  blake2b_g<V>(v[2], v[6], v[10], v[14], m[4], m[5]);
+  blake2b_g1<V>(v[3], v[7], v[11], v[15], m[6]);
+}
+
+// H0 for nonces `nonce` + lane, from a midstate taken with h0_midstate()
+template <class V>
+FORCE_INLINE void h0_from_midstate(typename V::reg h0[8],
+                                   const AquahashMidstate &mid,
+                                   uint64_t nonce) {
+  typedef typename V::reg reg;
+  const size_t N = V::width;
+  reg m[16];
+  reg v[16];
+  for (int w = 0; w < 16; w++) {
+    m[w] = V::set1(mid.m[w]);
+    v[w] = V::set1(mid.v[w]);
+  }
+  uint64_t lo[N];
+  uint64_t hi[N];
+  for (size_t k = 0; k < N; k++) {
+    lo[k] = mid.m[7] | ((nonce + k) << 32);
+    hi[k] = (nonce + k) >> 32;
+  }
+  m[7] = V::load(lo);
+  m[8] = V::load(hi);
+  blake2b_g2<V>(v[3], v[7], v[11], v[15], m[7]);
+  blake2b_diagonals<V>(v, m, 0);
+  blake2b_rounds<V>(v, m, 1);
+  blake2b_init<V>(h0, 64);
+  blake2b_finish<V>(h0, v);
+}
+
+// argon2 block compression
+
+template <class V>
+FORCE_INLINE void blamka_g(typename V::reg &a, typename V::reg &b,
+                           typename V::reg &c, typename V::reg &d) {
+  a = V::fBlaMka(a, b);
+  d = V::rotr32(V::xor_(d, a));
+  c = V::fBlaMka(c, d);
+  b = V::rotr24(V::xor_(b, c));
+  a = V::fBlaMka(a, b);
+  d = V::rotr16(V::xor_(d, a));
+  c = V::fBlaMka(c, d);
+  b = V::rotr63(V::xor_(b, c));
+}
+
+// BLAKE2_ROUND_NOMSG on 16 words of r, the i'th one at r[o[i]]
+template <class V>
+FORCE_INLINE void blamka_round(typename V::reg *r, const int o[16]) {
+  blamka_g<V>(r[o[0]], r[o[4]], r[o[8]], r[o[12]]);
+  blamka_g<V>(r[o[1]], r[o[5]], r[o[9]], r[o[13]]);
+  blamka_g<V>(r[o[2]], r[o[6]], r[o[10]], r[o[14]]);
+  blamka_g<V>(r[o[3]], r[o[7]], r[o[11]], r[o[15]]);
+  blamka_g<V>(r[o[0]], r[o[5]], r[o[10]], r[o[15]]);
+  blamka_g<V>(r[o[1]], r[o[6]], r[o[11]], r[o[12]]);
+  blamka_g<V>(r[o[2]], r[o[7]], r[o[8]], r[o[13]]);
+  blamka_g<V>(r[o[3]], r[o[4]], r[o[9]], r[o[14]]);
+}
+
+// reference block, same block in every lane
+template <class V>
+struct DirectRef {
+  const typename V::reg *p;
+  FORCE_INLINE typename V::reg operator()(int w) const { return p[w]; }
+};
+
+// reference block picked per lane (data dependent addressing)
+template <class V>
+struct GatherRef {
+  const uint64_t *base;
+  uint64_t off[V::width];
+  FORCE_INLINE typename V::reg operator()(int w) const {
+    return V::gather(base + w * V::width, off);
+  }
+};
+
+// next = G(prev ^ ref), argon2 fill_block without xor (first pass).
+// ref may be next itself, each word is read before it is written.
+template <class V, class Ref>
+FORCE_INLINE void fill_block(const typename V::reg *prev, const Ref &ref,
+                             typename V::reg *next) {
+  typedef typename V::reg reg;
+  reg R[ARGON2_QWORDS];
+  for (int w = 0; w < ARGON2_QWORDS; w++) {
+    R[w] = V::xor_(prev[w], ref(w));
+    next[w] = R[w];
+  }
+  // columns: (0..15), (16..31), ...
+  for (int i = 0; i < 8; i++) {
+    const int o[16] = {16 * i,      16 * i + 1,  16 * i + 2,  16 * i + 3,
+                       16 * i + 4,  16 * i + 5,  16 * i + 6,  16 * i + 7,
+                       16 * i + 8,  16 * i + 9,  16 * i + 10, 16 * i + 11,
+                       16 * i + 12, 16 * i + 13, 16 * i + 14, 16 * i + 15};
+    blamka_round<V>(R, o);
+  }
+  // rows: (0,1,16,17,...,112,113), (2,3,18,19,...), ...
+  for (int i = 0; i < 8; i++) {
+    const int o[16] = {2 * i,      2 * i + 1,  2 * i + 16, 2 * i + 17,
+                       2 * i + 32, 2 * i + 33, 2 * i + 48, 2 * i + 49,
+                       2 * i + 64, 2 * i + 65, 2 * i + 80, 2 * i + 81,
+                       2 * i + 96, 2 * i + 97, 2 * i + 112, 2 * i + 113};
+    blamka_round<V>(R, o);
+  }
+  for (int w = 0; w < ARGON2_QWORDS; w++) {
+    next[w] = V::xor_(next[w], R[w]);
+  }
+}
+
+// everything after H0: fill memory and hash the last block into `out`.
+// BLOCKS is the memory size in blocks when it is known at compile time,
+// one instantiation per aquahash version, or 0 to take it from `mem`.
+template <class V, uint32_t BLOCKS>
+FORCE_INLINE void batch_fill(uint8_t *out, const typename V::reg h0[8],
+                             uint32_t mem, void *memory) {
+  typedef typename V::reg reg;
+  const size_t N = V::width;
+  reg *B = static_cast<reg *>(memory);
+  const uint32_t blocks = BLOCKS != 0 ? BLOCKS : memory_blocks(mem);
+  const uint32_t seg = blocks / ARGON2_SLICES;
+  const uint32_t *irefs = independent_refs(blocks);
+  reg m[16];
+
+  // first two blocks: H'(1024, LE32(1024) || H0 || LE32(i) || LE32(lane 0))
+  for (uint32_t i = 0; i < 2; i++) {
+    reg *blk = B + i * ARGON2_QWORDS;
+    for (int w = 0; w < 16; w++) {
+      m[w] = V::set1(0);
+    }
+    m[0] = V::xor_(V::set1(1024), V::shl32(h0[0]));
+    for (int w = 1; w < 8; w++) {
+      m[w] = V::xor_(V::shr32(h0[w - 1]), V::shl32(h0[w]));
+    }
+    m[8] = V::xor_(V::shr32(h0[7]), V::set1(static_cast<uint64_t>(i) << 32));
+    reg v[8];
+    blake2b_init<V>(v, 64);
+    blake2b_compress<V>(v, m, 76, true);
+    for (int w = 0; w < 4; w++) {
+      blk[w] = v[w];
+    }
+    // each following 64 byte hash of the last gives 32 more bytes,
+    // except the last which gives all 64
+    for (int j = 1; j <= 30; j++) {
+      for (int w = 0; w < 8; w++) {
+        m[w] = v[w];
+        m[w + 8] = V::set1(0);
+      }
+      blake2b_init<V>(v, 64);
+      blake2b_compress<V>(v, m, 64, true);
+      for (int w = 0; w < (j == 30 ? 8 : 4); w++) {
+        blk[4 * j + w] = v[w];
+      }
+    }
+  }
+
+  // the single pass over memory. Slices 0 and 1 reference blocks known
+  // in advance, slices 2 and 3 the ones the previous block picks.
+  for (uint32_t cur = 2; cur < 2 * seg; cur++) {
+    DirectRef<V> ref = {B + irefs[cur] * ARGON2_QWORDS};
+    fill_block<V>(B + (cur - 1) * ARGON2_QWORDS, ref, B + cur * ARGON2_QWORDS);
+  }
+  for (uint32_t cur = 2 * seg; cur < blocks; cur++) {
+    const reg *prev = B + (cur - 1) * ARGON2_QWORDS;
+    uint64_t pseudo_rand[N];
+    V::store(pseudo_rand, prev[0]);
+    GatherRef<V> ref;
+    ref.base = reinterpret_cast<const uint64_t *>(B);
+    for (size_t k = 0; k < N; k++) {
+      uint64_t r = index_alpha(pseudo_rand[k], cur - 1);
+      ref.off[k] = r * ARGON2_QWORDS * N + k;
+    }
+    fill_block<V>(prev, ref, B + cur * ARGON2_QWORDS);
+  }
+
+  // H'(32, LE32(32) || last block), 1028 bytes over 9 BLAKE2b blocks
+  const reg *last = B + (blocks - 1) * ARGON2_QWORDS;
+  reg h[8];
+  blake2b_init<V>(h, HASH_LEN);
+  for (int b = 0; b < 9; b++) {
+    for (int w = 0; w < 16; w++) {
+      int q = 16 * b + w;  // 8 byte word of the message, 4 bytes off
+      if (q == 0) {
+        m[w] = V::xor_(V::set1(HASH_LEN), V::shl32(last[0]));
+      } else if (q < ARGON2_QWORDS) {
+        m[w] = V::xor_(V::shr32(last[q - 1]), V::shl32(last[q]));
+      } else if (q == ARGON2_QWORDS) {
+        m[w] = V::shr32(last[q - 1]);
+      } else {
+        m[w] = V::set1(0);
+      }
+    }
+    blake2b_compress<V>(h, m, b < 8 ? 128 * (b + 1) : 1028, b == 8);
+  }
+  uint64_t words[4][N];
+  for (int w = 0; w < 4; w++) {
+    V::store(words[w], h[w]);
+  }
+  for (size_t k = 0; k < N; k++) {
+    for (int w = 0; w < 4; w++) {
+      memcpy(out + k * HASH_LEN + 8 * w, &words[w][k], 8);
+    }
+  }
+}
+
+template <class V, uint32_t BLOCKS>
+void batch_hash(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory) {
+  typedef typename V::reg reg;
+  const size_t N = V::width;
+
+  // H0: all 80 bytes of parameters and input fit in one BLAKE2b block
+  uint64_t words[16][N];
+  for (size_t k = 0; k < N; k++) {
+    uint64_t msg[16];
+    h0_message(msg, in + k * HASH_INPUT_LEN, mem);
+    for (int w = 0; w < 16; w++) {
+      words[w][k] = msg[w];
+    }
+  }
+  reg m[16];
+  for (int w = 0; w < 16; w++) {
+    m[w] = V::load(words[w]);
+  }
+  reg h0[8];
+  blake2b_init<V>(h0, 64);
+  blake2b_compress<V>(h0, m, 80, true);
+  batch_fill<V, BLOCKS>(out, h0, mem, memory);
+}
+
+template <class V, uint32_t BLOCKS>
+void batch_hash_nonces(uint8_t *out, const AquahashMidstate &mid,
+                       uint64_t nonce, void *memory) {
+  typename V::reg h0[8];
+  h0_from_midstate<V>(h0, mid, nonce);
+  batch_fill<V, BLOCKS>(out, h0, mid.mem, memory);
+}
+
+// batch_hash for any m_cost, specialized ones for the aquahash versions
+template <class V>
+void batch_hash_any(uint8_t *out, const uint8_t *in, uint32_t mem,
+                    void *memory) {
+  switch (memory_blocks(mem)) {
+    case 8:  // v2
+      return batch_hash<V, 8>(out, in, mem, memory);
+    case 16:  // v3
+      return batch_hash<V, 16>(out, in, mem, memory);
+    case 32:  // v4
+      return batch_hash<V, 32>(out, in, mem, memory);
+    default:
+      return batch_hash<V, 0>(out, in, mem, memory);
+  }
+}
+
+// the batch_hash_nonces kernel for m_cost `mem`, picked once per job
+template <class V>
+AquahashNoncesFn batch_hash_nonces_for(uint32_t mem) {
+  switch (memory_blocks(mem)) {
+    case 8:
+      return batch_hash_nonces<V, 8>;
+    case 16:
+      return batch_hash_nonces<V, 16>;
+    case 32:
+      return batch_hash_nonces<V, 32>;
+    default:
+      return batch_hash_nonces<V, 0>;
+  }
+}
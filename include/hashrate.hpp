@@ -0,0 +1,101 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_HASHRATE_H
+#define M_HASHRATE_H
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// aquahash versions '2', '3' and '4', for per version hashrate
+#define NUM_VERSIONS (3)
+// how often HashrateMeter::sample() folds the counters into rates
+#define HASHRATE_SAMPLE_MS (1000)
+// bytes per thread counter: two cache lines, so neither a neighbour nor the
+// adjacent line prefetcher ever pulls in another thread's counter
+#define HASHRATE_COUNTER_BYTES (128)
+
+// HashRates is one hashrate, H/s: over the last sample and as exponentially
+// weighted moving averages over 1, 5 and 15 minutes
+struct HashRates {
+  double now;
+  double m1;
+  double m5;
+  double m15;
+};
+
+// HashrateMeter counts hashes per miner thread and turns them into rates.
+// Each thread owns a counter on cache lines of its own and is the only one
+// to write it, a plain relaxed store per batch, so threads never contend.
+// One sampler thread reads all of them every HASHRATE_SAMPLE_MS. Rates can
+// be read from any thread.
+class HashrateMeter {
+ public:
+  explicit HashrateMeter(uint8_t threads);
+  // miner thread `thread_id` (1 based) hashed `n` more on `version`. Only
+  // that thread may call it.
+  void add(uint8_t thread_id, char version, uint64_t n) {
+    Counter &c = counters[thread_id];
+    c.hashes.store(c.hashes.load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+    if (version >= '2' && version < '2' + NUM_VERSIONS) {
+      std::atomic<uint64_t> &v = c.versionHashes[version - '2'];
+      v.store(v.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+    }
+  }
+  // fold the counters into rates if HASHRATE_SAMPLE_MS went by since the
+  // last time, one thread only
+  void sample(std::chrono::steady_clock::time_point now);
+  void sample() { sample(std::chrono::steady_clock::now()); }
+  // hashes so far, exact
+  uint64_t hashes() const;
+  HashRates total() const;
+  HashRates thread(uint8_t thread_id) const;
+  double version(int v) const;  // version '2' + v, over the last sample
+  uint8_t threads() const { return numThreads; }
+
+ private:
+  HashrateMeter(const HashrateMeter &);
+  HashrateMeter &operator=(const HashrateMeter &);
+  struct Counter {
+    std::atomic<uint64_t> hashes;
+    std::atomic<uint64_t> versionHashes[NUM_VERSIONS];
+    char pad[HASHRATE_COUNTER_BYTES - (1 + NUM_VERSIONS) * 8];
+  };
+  // new[] only aligns to 16 bytes before C++17, so the counters are
+  // posix_memalign'd to HASHRATE_COUNTER_BYTES and freed with free()
+  static Counter *newCounters(int n);
+  struct FreeCounters {
+    void operator()(Counter *c) const;
+  };
+  uint8_t numThreads;
+  std::unique_ptr<Counter[], FreeCounters> counters;  // 1 based, like ids
+  // sampler state, under mu
+  mutable std::mutex mu;
+  unsigned long numSamples;  // 0 until the first sample() sets a start
+  std::chrono::steady_clock::time_point lastSample;
+  std::vector<uint64_t> lastHashes;  // by thread, 0 is the total
+  std::vector<HashRates> rates;      // same
+  uint64_t lastVersionHashes[NUM_VERSIONS];
+  double versionRates[NUM_VERSIONS];
+};
+
+#endif  // M_HASHRATE_H
@@ -0,0 +1,47 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_HEXCODEC_H
+#define M_HEXCODEC_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Hex encoding and decoding for work headers, targets and nonces. Each call
+// goes to the widest codec this cpu runs (avx2, ssse3, then a lookup table
+// one byte at a time), picked once like the hashing kernels.
+
+// `len` bytes as lowercase hex into `out`, which must hold 2 * len + 1 chars.
+// NUL terminated.
+void hexEncode(char *out, const uint8_t *in, size_t len);
+// `digits` hex digits (either case) into digits / 2 bytes of `out`. False if
+// `digits` is odd or any of them isn't hex, `out` is garbage then.
+bool hexDecode(uint8_t *out, const char *in, size_t digits);
+// a NUL terminated hex string, 0x prefix optional, into `out`, which must
+// hold half its digits. False like hexDecode.
+bool hexDecodeString(uint8_t *out, const char *in);
+// name of the codec in use (table, ssse3, avx2)
+const char *hexIsa();
+// use the named codec instead of the one picked from cpuid, "auto" goes
+// back to picking. Returns false if it is unknown or this cpu can't run it.
+// Call before any hex goes through.
+bool hexSelect(const std::string &name);
+// space separated codecs this cpu can run, widest first
+std::string hexCodecs();
+
+#endif  // M_HEXCODEC_H
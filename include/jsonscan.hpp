@@ -0,0 +1,49 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_JSONSCAN_H
+#define M_JSONSCAN_H
+#include <jsoncpp/json/value.h>  // for Value
+#include <stddef.h>
+
+// longest hex string kept from a job: 0x and 64 digits
+#define JOB_HEX_LEN (66)
+
+// GetworkJob is one job, [input, seed hash, target, difficulty] as the pool
+// sends it, checked and kept in fixed size fields
+struct GetworkJob {
+  char input[JOB_HEX_LEN + 1];  // header hash, 0x and 64 hex digits
+  char version;                 // aquahash version, last seed hash digit
+  char target[JOB_HEX_LEN + 1];
+  char difficulty[JOB_HEX_LEN + 1];
+};
+
+// Fixed schema scanners for the two replies the miner polls the pool for.
+// They read straight from the receive buffer into the caller's storage
+// without allocating: every member but "result" is checked to be well
+// formed JSON and skipped, and anything unexpected (escapes in keys or in
+// job fields, duplicate "result", trailing data) is refused.
+//
+// aqua_getWork reply, {"result": [input, seed hash, target, difficulty]}
+bool scanGetwork(const char *buf, size_t len, GetworkJob *job);
+// aqua_submitWork reply, {"result": true or false}
+bool scanSubmit(const char *buf, size_t len, bool *accepted);
+
+// the same checks on a job jsoncpp already parsed (stratum params)
+bool jobFromJson(const Json::Value &val, GetworkJob *job);
+
+#endif  // M_JSONSCAN_H
@@ -0,0 +1,115 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_METRICS_H
+#define M_METRICS_H
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hashrate.hpp"
+
+// latency histogram bucket upper bounds, seconds, +Inf comes after
+#define METRICS_BUCKETS \
+  { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 }
+#define METRICS_NUM_BUCKETS (13)
+
+// LatencyHistogram counts latencies into fixed buckets, lock free, for the
+// metrics endpoint. Any thread can observe().
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  void observe(double ms);
+  struct Snapshot {
+    unsigned long long buckets[METRICS_NUM_BUCKETS + 1];  // not cumulative
+    unsigned long long count;
+    double sum;  // seconds
+  };
+  Snapshot snapshot() const;
+
+ private:
+  LatencyHistogram(const LatencyHistogram &);
+  LatencyHistogram &operator=(const LatencyHistogram &);
+  std::atomic<unsigned long long> buckets[METRICS_NUM_BUCKETS + 1];
+  std::atomic<unsigned long long> sumMicros;
+};
+
+// MetricsSnapshot is everything the endpoint shows, copied out of the miner
+// when it is scraped
+struct MetricsSnapshot {
+  std::string version;
+  std::string kernel;
+  double uptime;    // seconds
+  HashRates hashrate;  // H/s, last second and moving averages
+  unsigned long long hashes;
+  std::vector<HashRates> threadHashrate;  // thread n at n-1
+  std::vector<std::pair<char, double>> versionHashrate;  // aquahash version
+  unsigned long long foundShares;  // solutions found, below block target
+  unsigned long long foundBlocks;  // solutions that met the block target
+  unsigned long long accepted;
+  unsigned long long rejected;
+  unsigned long long stale;    // dropped, the work had moved on
+  unsigned long long dropped;  // dropped, the pool never answered
+  unsigned long long errors;   // pool replies that made no sense
+  struct Pool {
+    std::string url;
+    bool active;
+    bool up;
+    double latency;    // ms
+    double errorRate;  // 0 to 1
+    unsigned long long accepted;
+    unsigned long long rejected;
+  };
+  std::vector<Pool> pools;
+  LatencyHistogram::Snapshot getwork;
+  LatencyHistogram::Snapshot submit;
+  LatencyHistogram::Snapshot workSwitch;
+};
+
+// Prometheus text format, and the same as one JSON object
+std::string metricsText(const MetricsSnapshot &m);
+std::string metricsJson(const MetricsSnapshot &m);
+
+// MetricsServer answers GET /metrics (Prometheus) and /metrics.json on its
+// own thread, one short request at a time, with whatever render() returns.
+class MetricsServer {
+ public:
+  typedef std::function<MetricsSnapshot()> Render;
+  MetricsServer();
+  ~MetricsServer();
+  // listen on "[host:]port", 127.0.0.1 if no host, port 0 for any free one
+  bool start(const std::string &listen, Render render);
+  void stop();
+  int port() const { return boundPort; }
+
+ private:
+  MetricsServer(const MetricsServer &);
+  MetricsServer &operator=(const MetricsServer &);
+  void acceptLoop();
+  void serve(int fd);
+  int listenfd;
+  int boundPort;
+  Render render;
+  std::atomic<bool> running;
+  std::thread acceptor;
+};
+
+#endif  // M_METRICS_H
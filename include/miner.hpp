@@ -21,41 +21,60 @@
 #include <gmp.h>
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "aqua.hpp"
+#include "hashrate.hpp"
+#include "jsonscan.hpp"
+#include "metrics.hpp"
+#include "nonce.hpp"
+#include "pool.hpp"
+#include "stratum.hpp"
+#include "submit.hpp"
+#include "target.hpp"
+#include "work.hpp"
 #include "spdlog/sinks/stdout_color_sinks.h"
-#define HASH_LEN (32)
-#define HASH_INPUT_LEN (40)
 #define zero32 \
   "0x0000000000000000000000000000000000000000000000000000000000000000"
 
+// WorkPacket is what a miner thread hashes: the current job, shared with
+// the other threads, and the thread's own buffers
 class WorkPacket {
  public:
   WorkPacket();
-  uint8_t *input;
-  char inputStr[67];  // copied from getWork
-  char version = 0;
-  mpz_t difficulty;
-  mpz_t target;
+  ~WorkPacket();
+  std::shared_ptr<const Work> job;  // nullptr until there is work
   uint8_t *output;
   uint64_t nonce = 0;
   uint8_t *noncebuf;
   uint8_t buf[40];  // input + nonce
+  uint64_t epoch;   // WorkChannel epoch of job, 0 for none
  private:
 };
 
 bool getwork(const std::string endpoint, WorkPacket *work, const bool verbose);
-bool submitwork(WorkPacket *work, std::string endpoint, const bool verbose,
-                CURL *curl);
+
+SubmitResult submitwork(const Share *share, CURL *curl);
+SubmitResult submitwork(const Share *share, StratumClient *stratum);
+// tries per share before the submit thread gives up on it
+#define SUBMIT_TRIES (5)
 
 // Miner Class
 class Miner {
  public:
-  Miner(const std::string url, const uint8_t nThreads, const uint8_t nCPU,
-        const bool verboseLogs, const bool benching, const bool solo);
+  Miner(const std::vector<PoolSpec> &poolSpecs, const bool split,
+        const uint8_t nThreads, const uint8_t nCPU,
+        const bool verboseLogs, const bool benching, const bool solo,
+        const int noncePrefix, const std::vector<int> &pinCpus,
+        const int batch, const std::string &metricsListen,
+        const unsigned long long shareDiff);
   ~Miner();
   void start(void);
 
@@ -63,51 +82,71 @@ class Miner {
   bool verbose;
   bool benching;
   bool solomining;
-  std::string poolUrl;
+  std::vector<Pool *> pools;  // --pool, in the order given
+  int activePool;             // mining its job, -1 before the first one
+  bool splitPools;            // --pool-split
+  std::chrono::steady_clock::time_point sliceEnd;  // of activePool's turn
   uint8_t numThreads;
   int num_cpus;
-  bool getwork();
-  CURL *getworkcurl;
-  CURL *submitcurl;
-  void initcurl(CURL *, int);                  // int typ defined in http.cpp
+  bool useEngine;       // batched engine passed its self test
+  size_t hashLanes;     // nonces per batch
+  int batchWidths;      // hashLanes in kernel widths, --batch
+  std::vector<int> pinCpus;  // thread n on pinCpus[n-1], --pin
+  uint16_t rigPrefix;   // high nonce bits, --nonce-prefix
+  NonceAllocator *nonces;
+  JobTargets targets;  // for loadWork, holding publishmu
+  std::atomic<unsigned long long> foundShares;  // solutions, not blocks
+  std::atomic<unsigned long long> foundBlocks;  // met the block target
+  WorkSwitchClock *switchClock;  // new work to all threads switched
+  HashrateMeter *meter;          // hashes by thread
+  bool getwork(Pool *pool, CURL *curl, std::string *longPoll);
+  bool setWork(Pool *pool, const Json::Value &job);
+  bool setWork(Pool *pool, const GetworkJob &job);
+  void selectPool(bool rotate);
+  void switchPool(bool rotate);  // selectPool, holding publishmu
+  void loadWork(const Pool *pool);
+  void poolThread(Pool *pool);
+  void stratumWork(Pool *pool, long ms);
+  void longPollThread(Pool *pool, std::string url);
+  void reportHashrate(double seconds, uint64_t *lastHashes);
+  std::mutex publishmu;  // for currentWork, activePool and the pool jobs
+  // int typ defined in http.cpp
+  void initcurl(CURL *curl, int typ, const std::string &url);
+  struct curl_slist *headers;  // every handle's, outlives them
   std::shared_ptr<spdlog::logger> logger;      // for miner
   std::shared_ptr<spdlog::logger> getworklog;  // for getwork
-  std::mutex workmu;
+  WorkChannel workChannel;  // currentWork, as the miner threads see it
+  void publishWork(const std::shared_ptr<Work> &work);
+  // point work_t at the latest job, the getwork thread already logged it
   bool getCurrentWork(WorkPacket *work_t, uint8_t thread_id) {
-    // workmu.lock();
-    if (currentWork->version == 0) {
-      // workmu.unlock();
+    std::shared_ptr<const Work> job = workChannel.read();
+    if (job == nullptr) {
       spdlog::debug("no work yet...");
       return false;
     }
-    if (strcmp(currentWork->inputStr, work_t->inputStr) == 0) {
-      // workmu.unlock();
+    if (job->epoch == work_t->epoch) {
       return true;
     }
-    // print new work
-    // TODO: move to getwork thread
-    logger->info("CPU {} new work: algo '{}' diff: {} input: {}", thread_id,
-                 currentWork->version,
-                 mpzToString(currentWork->difficulty).c_str(),
-                 std::string(currentWork->inputStr).substr(0, 8));
-    work_t->version = currentWork->version;
-    memcpy(work_t->input, currentWork->input, 32);
-    memcpy(work_t->buf, currentWork->input, 32);
-    work_t->input = currentWork->input;
-    work_t->version = currentWork->version;
-    mpz_set(work_t->difficulty, currentWork->difficulty);
-    mpz_set(work_t->target, currentWork->target);
-    strcpy(work_t->inputStr, currentWork->inputStr);
-    // workmu.unlock();
+    work_t->job = std::move(job);
+    work_t->epoch = work_t->job->epoch;
+    memcpy(work_t->buf, work_t->job->input, 32);
+    logger->debug("thread {} on work {}", thread_id, work_t->epoch);
     return true;
   };
   void minerThread(uint8_t id);
   void getworkThread(const char *id);
-  //  void submitworkThread(const char *id);
-  WorkPacket *currentWork;
+  void submitThread();
+  ShareQueue submitQueue;  // miner threads to submitThread
+  std::shared_ptr<const Work> currentWork;  // last published, publishmu
 
-  std::atomic<unsigned long long> numTries;
-  void submitTries(uint8_t thread_id, uint64_t numTries);
+  // for the metrics endpoint
+  std::string metricsListen;  // --metrics, empty for none
+  MetricsServer metricsServer;
+  std::chrono::steady_clock::time_point startedAt;
+  LatencyHistogram getworkLatency;
+  LatencyHistogram submitLatency;
+  LatencyHistogram switchLatency;
+  MetricsSnapshot metrics();
 };
 
 // bool getwork(const std::string endpoint, WorkPacket *work, const bool
@@ -0,0 +1,77 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_NONCE_H
+#define M_NONCE_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+// 64-bit nonce layout, high to low:
+//   16 bits rig prefix (--nonce-prefix, random if unset)
+//    8 bits range slot (the miner thread id, or a spare slot)
+//   40 bits counter
+// so no two threads, and no two rigs with different prefixes, ever hash the
+// same nonce for the same work.
+#define NONCE_PREFIX_SHIFT (48)
+#define NONCE_SLOT_SHIFT (40)
+#define NONCE_SLOTS (256)
+#define NONCE_RANGE_SIZE (1ULL << NONCE_SLOT_SHIFT)
+
+// NonceRange is the block of nonces one thread walks through
+struct NonceRange {
+  uint64_t start;
+  uint64_t next;
+  uint64_t end;
+  // take `n` consecutive nonces, false if the range is used up
+  bool take(size_t n, uint64_t *first) {
+    if (end - next < n) {
+      return false;
+    }
+    *first = next;
+    next += n;
+    return true;
+  }
+  uint64_t used() const { return next - start; }
+};
+
+// NonceAllocator hands out the nonce ranges of one rig
+class NonceAllocator {
+ public:
+  NonceAllocator(uint16_t prefix, uint8_t threads);
+  uint16_t prefix() const { return rigPrefix; }
+  // the thread's own range, from the beginning. Called on new work.
+  NonceRange assign(uint8_t thread_id);
+  // a spare range for a thread that used up its own before new work came.
+  // Once the spares run out the thread's own range starts over.
+  NonceRange extend(uint8_t thread_id);
+  // nonces the thread has used of its ranges for the current work
+  void record(uint8_t thread_id, uint64_t used);
+  uint64_t used(uint8_t thread_id) const;
+
+ private:
+  NonceAllocator(const NonceAllocator &);
+  NonceAllocator &operator=(const NonceAllocator &);
+  NonceRange range(uint8_t slot) const;
+  uint16_t rigPrefix;
+  std::atomic<unsigned> nextSpare;
+  std::unique_ptr<std::atomic<uint64_t>[]> usedBy;
+};
+
+#endif  // M_NONCE_H
@@ -0,0 +1,154 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_POOL_H
+#define M_POOL_H
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jsonscan.hpp"
+#include "stratum.hpp"
+
+// mine here when no --pool is given
+#define POOL_DEFAULT_URL "http://127.0.0.1:8543"
+// latency that halves a pool's score
+#define POOL_RTT_REF_MS (100.0)
+// a pool of the same priority must score this much better to take over
+#define POOL_SWITCH_MARGIN (1.5)
+// --pool-split: a pool mines weight * POOL_SLICE_MS at a time
+#define POOL_SLICE_MS (5000)
+// --solo: after a block, poll this often for the next template, for up to
+// POOL_CHASE_MAX_MS
+#define POOL_CHASE_MS (10)
+#define POOL_CHASE_MAX_MS (3000)
+// getwork polling: every POLL_RTT_FACTOR round trips, within these bounds,
+// and a second after a failed poll
+#define POLL_MIN_MS (250)
+#define POLL_MAX_MS (3000)
+#define POLL_RTT_FACTOR (8)
+#define POLL_RETRY_MS (1000)
+// long polling: how long to let the pool hold a request, how often to poll
+// anyway, how many failures in a row before going back to polling, and the
+// wait after each of them (times the failures so far)
+#define LONGPOLL_TIMEOUT (90)
+#define LONGPOLL_POLL_MS (30000)
+#define LONGPOLL_FAILURES (3)
+#define LONGPOLL_BACKOFF_MS (1000)
+
+// PoolSpec is one --pool value: "URL [priority=N] [weight=N]". Lower
+// priorities are used first, higher ones are failover. Weight is the share
+// of hashrate a pool gets among ready pools of the same priority with
+// --pool-split.
+struct PoolSpec {
+  std::string url;
+  int priority;
+  int weight;
+};
+bool parsePoolSpec(const std::string &spec, PoolSpec *pool);
+
+// Pool is one pool the miner can take work from: its connections, its
+// latest job and how well it has been answering lately. Health is updated
+// by the pool's own getwork thread and by the submit thread.
+class Pool {
+ public:
+  Pool(const PoolSpec &spec, int index);
+  ~Pool();
+  const PoolSpec spec;
+  const int index;          // in Miner::pools, shown 1 based
+  CURL *getworkcurl;        // owned, set up by Miner::initcurl
+  CURL *submitcurl;         // same
+  StratumClient *stratum;   // nullptr unless the url is stratum+tcp://
+  std::atomic<bool> longPolling;  // a longPollThread is running
+  std::atomic<unsigned long long> accepted;
+  std::atomic<unsigned long long> rejected;
+  GetworkJob job;  // latest job, under Miner::publishmu
+  bool hasJob;     // same
+
+  // a request got an answer after `ms` (negative if not timed)
+  void answered(double ms);
+  // a request failed, the pool is down until it answers again
+  void failed();
+  bool up() const;
+  double latency() const;    // ms, EWMA of timed answers, 0 if none yet
+  double errorRate() const;  // EWMA of failed requests, 0 to 1
+  // health: 1 for a pool that always answers instantly, lower for errors
+  // and latency
+  double score() const;
+
+  // --solo: a block was found on the pool's job. Wakes the pool thread for
+  // a getwork now, and it keeps chasing the next template every
+  // POOL_CHASE_MS until newJob().
+  void wake();
+  // the pool thread's wait between polls, cut short by wake()
+  void sleep(int ms);
+  bool chasing() const;
+  // the pool's job changed
+  void newJob();
+
+  // ms until the next getwork poll
+  int pollInterval() const;
+  // one turn of the pool thread's getwork loop: `fetch` a job, then sleep
+  // until the next poll is due or wake(), POLL_RETRY_MS if fetch failed.
+  // Returns what fetch did.
+  bool poll(const std::function<bool()> &fetch);
+  // the long poll thread's loop: `fetch` (one long poll, true if it brought
+  // work) back to back until it fails LONGPOLL_FAILURES times in a row,
+  // waiting `backoffMs` times the failures so far after each. Then
+  // longPolling is cleared and the pool thread polls at its own pace.
+  void longPoll(const std::function<bool()> &fetch, int backoffMs);
+
+ private:
+  Pool(const Pool &);
+  Pool &operator=(const Pool &);
+  mutable std::mutex mu;
+  double rtt;
+  double errors;
+  bool down;
+  bool woken;
+  std::chrono::steady_clock::time_point chaseEnd;
+  std::condition_variable wakecv;
+};
+
+// the long poll url a pool advertises, relative to the pool url or not
+std::string resolveUrl(const std::string &base, const std::string &ref);
+// CURLOPT_HEADERFUNCTION picking the X-Long-Polling header out of a reply,
+// its value goes to `longPoll`
+std::size_t longPollHeader(const char *in, std::size_t size, std::size_t num,
+                           std::string *longPoll);
+
+// PoolChoice is what choosePool() looks at for one pool
+struct PoolChoice {
+  int priority;
+  bool ready;  // up, with a job
+  double score;
+};
+
+// The pool to mine on: a ready pool of the lowest priority that has one,
+// -1 if none is ready. `active` (or -1) is kept while it is in that group,
+// unless another one scores POOL_SWITCH_MARGIN times better. With `split`,
+// the group takes turns instead: `rotate` moves on to the next one.
+int choosePool(const std::vector<PoolChoice> &pools, int active, bool split,
+               bool rotate);
+
+#endif  // M_POOL_H
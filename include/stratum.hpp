@@ -0,0 +1,74 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_STRATUM_H
+#define M_STRATUM_H
+#include <jsoncpp/json/value.h>  // for Value
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "submit.hpp"
+
+#define STRATUM_SCHEME "stratum+tcp://"
+
+// StratumClient talks line delimited JSON-RPC to a pool over one TCP
+// connection that stays open. The pool pushes jobs with mining.notify
+// (params are the same four strings as an aqua_getWork result), may change
+// the share target with mining.set_target [target] and answers
+// mining.submit on the same socket, so there is no polling and no per
+// request connection setup.
+//
+// One thread reads (nextJob), any other thread may submit(); answers to
+// submits are picked up by the reader and handed over.
+class StratumClient {
+ public:
+  StratumClient();
+  ~StratumClient();
+  // host and port of a stratum+tcp://host:port url
+  static bool parseUrl(const std::string &url, std::string *host,
+                       std::string *port);
+  // connect and subscribe, false if the pool can't be reached
+  bool connect(const std::string &url, const std::string &agent);
+  void disconnect();
+  bool connected() const { return up.load(); }
+  // wait up to `ms` for the next job, false on timeout or lost connection
+  bool nextJob(Json::Value *params, int ms);
+  // send one share and wait up to `ms` for the pool's answer
+  SubmitResult submit(const char *nonceHex, const char *inputStr, int ms);
+
+ private:
+  StratumClient(const StratumClient &);
+  StratumClient &operator=(const StratumClient &);
+  bool send(const std::string &line);
+  bool handle(const std::string &line, Json::Value *params);
+  void lost();
+  int fd;
+  std::atomic<bool> up;
+  std::string inbuf;  // read, not yet handled, reader only
+  Json::Value lastJob;      // mining.notify params, reader only
+  std::string shareTarget;  // mining.set_target, reader only
+  std::atomic<int> nextId;
+  std::mutex writemu;  // for fd
+  std::mutex resultmu;
+  std::condition_variable resultcv;
+  std::map<int, int> results;  // submit id: -1 waiting, 0 rejected, 1 ok
+};
+
+#endif  // M_STRATUM_H
@@ -0,0 +1,84 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_SUBMIT_H
+#define M_SUBMIT_H
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+enum SubmitResult {
+  SUBMIT_ACCEPTED,
+  SUBMIT_REJECTED,  // pool said no, don't send it again
+  SUBMIT_FAILED,    // never got an answer, worth another try
+};
+
+// Share is one solution waiting to go to the pool
+struct Share {
+  uint64_t nonce;
+  char inputStr[67];     // work it solves, as the pool sent it
+  int pool;              // Miner::pools index the work came from
+  uint64_t epoch;        // WorkChannel epoch of that work
+  uint8_t thread_id;     // who found it
+  bool block;            // met the block target too, sent ahead of shares
+  std::chrono::steady_clock::time_point foundAt;
+  std::atomic<Share *> next;
+};
+
+// ShareQueue hands shares from the miner threads to the submit thread.
+// Any number of threads push() onto an intrusive MPSC queue, one thread
+// pop()s. Linking a share in is lock free, but push() then takes and drops
+// the waiter's mutex so a popper going to sleep can't miss it; shares are
+// rare enough that this costs nothing. The pusher gives up ownership of
+// the share, the popper deletes it. Blocks go in a lane of their own that
+// is always popped first, so a block never waits behind a backlog of
+// shares.
+class ShareQueue {
+ public:
+  ShareQueue();
+  ~ShareQueue();
+  void push(Share *share);
+  // oldest share, or nullptr if empty
+  Share *pop();
+  // pop, waiting up to `ms` for a share to arrive
+  Share *wait(int ms);
+  // wake the waiting popper for good, pop() still drains what is left
+  void close();
+  bool closed() const { return isClosed.load(); }
+
+ private:
+  ShareQueue(const ShareQueue &);
+  ShareQueue &operator=(const ShareQueue &);
+  struct Lane {
+    std::atomic<Share *> head;  // last pushed
+    Share *tail;                // next to pop, only touched by the popper
+    Share stub;
+  };
+  static void link(Lane *lane, Share *share);
+  static Share *pop(Lane *lane);
+  static bool empty(Lane *lane);
+  Lane blocks;
+  Lane shares;
+  std::atomic<bool> isClosed;
+  std::mutex waitmu;
+  std::condition_variable waitcv;
+};
+
+#endif  // M_SUBMIT_H
@@ -0,0 +1,59 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_TARGET_H
+#define M_TARGET_H
+#include <gmp.h>
+#include <stdint.h>
+
+#include <string>
+
+// 2^256, built once on first use and read only after that, so any thread
+// may use it
+mpz_srcptr mpz_maxBest();
+// target = 2 ^ 256 / difficulty, into an initialized mpz. A zero
+// difficulty gives 2^256, the easiest target there is.
+void computeTarget(mpz_srcptr mpz_difficulty, mpz_ptr mpz_target);
+// difficulty = 2 ^ 256 / target, same
+void computeDifficulty(mpz_srcptr mpz_target, mpz_ptr mpz_difficulty);
+
+// JobTargets works out what the miner threads need from a job's target and
+// difficulty: the share target, the block target and the share difficulty
+// for the log. Its scratch mpz values are allocated once and reused for
+// every job, one thread at a time.
+class JobTargets {
+ public:
+  JobTargets();
+  ~JobTargets();
+  // --share-diff, 0 for whatever the pool asks
+  void setMinShareDifficulty(unsigned long long difficulty);
+  // from `target` (the pool's share target) and `difficulty` (the
+  // network's), 0x hex as the pool sent them. `shareTarget` must be
+  // initialized. The block target is never above the share target.
+  void compute(const char *target, const char *difficulty,
+               mpz_ptr shareTarget, uint64_t shareWords[4],
+               uint64_t blockWords[4], std::string *shareDifficulty);
+
+ private:
+  JobTargets(const JobTargets &);
+  JobTargets &operator=(const JobTargets &);
+  mpz_t minShareTarget;  // 0 for none
+  mpz_t netDifficulty;
+  mpz_t blockTarget;
+  mpz_t scratch;
+};
+
+#endif  // M_TARGET_H
@@ -0,0 +1,57 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#ifndef M_TOPOLOGY_H
+#define M_TOPOLOGY_H
+#include <string>
+#include <vector>
+
+// thread placement, --pin
+#define PIN_NONE "none"        // leave it to the scheduler
+#define PIN_COMPACT "compact"  // fill a core's SMT siblings, then the next core
+#define PIN_SCATTER "scatter"  // one per core across nodes first, then siblings
+#define PIN_CORES "cores"      // physical cores only, never two on one core
+#define PIN_LIST "list"        // the cpus given with --cpu-list, in order
+
+// CpuInfo is where one cpu (hardware thread) sits, from
+// /sys/devices/system/cpu
+struct CpuInfo {
+  int cpu;
+  int core;     // core_id, only unique within a package
+  int package;  // physical_package_id
+  int node;     // NUMA node, 0 without NUMA
+  int sibling;  // 0 for the first hardware thread of its core, 1 ..
+};
+
+// cpus this process may run on (taskset and cgroups included), at least 1
+int onlineCpus();
+// the cpus this process may run on, ordered by cpu number. Without /sys
+// every cpu is its own core on node 0.
+std::vector<CpuInfo> cpuTopology();
+// "2 nodes, 2 packages, 16 cores, 32 cpus"
+std::string describeTopology(const std::vector<CpuInfo> &cpus);
+// true if `policy` is one --pin knows (PIN_LIST comes from --cpu-list)
+bool pinPolicyKnown(const std::string &policy);
+// cpu numbers in the order miner threads take them under `policy`,
+// thread n gets order[(n - 1) % size]. Empty for PIN_NONE.
+std::vector<int> pinOrder(const std::string &policy,
+                          const std::vector<CpuInfo> &cpus);
+// "0,2,4-7" as cpu numbers, false if it doesn't parse
+bool parseCpuList(const std::string &list, std::vector<int> *out);
+// keep the calling thread on `cpu`, false if the kernel says no
+bool pinThread(int cpu);
+
+#endif  // M_TOPOLOGY_H
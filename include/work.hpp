@@ -0,0 +1,114 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_WORK_H
+#define M_WORK_H
+#include <gmp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Work is one job from the pool. A pool or long poll thread fills it in
+// once, log strings included, and publishes it. From then on it is read
+// only and shared by every miner thread until the last one moves on.
+struct Work {
+  Work();
+  ~Work();
+  uint8_t input[32];        // header hash
+  char inputStr[67];        // input as sent by the pool
+  char version;             // aquahash version, '2', '3', '4'
+  uint64_t targetWords[4];  // share target, see targetToWords()
+  uint64_t blockWords[4];   // block target, never above the share one
+  mpz_t target;             // share target, to double check candidates
+  std::string difficulty;   // share difficulty in decimal, for logs
+  int pool;                 // Miner::pools index it came from
+  uint64_t epoch;           // WorkChannel epoch, set by publish()
+
+ private:
+  Work(const Work &);
+  Work &operator=(const Work &);
+};
+
+// WorkChannel publishes work from the pool threads to the miner threads.
+// Jobs are immutable snapshots shared by reference count: a thread switches
+// to new work by taking a reference, nothing is copied, and the last thread
+// to let go of a job frees it. Hashing threads only look at epoch() between
+// batches and read() once per new epoch, so a publish costs them at most a
+// short wait on read()'s lock, never a stall per batch. Threads with
+// nothing to hash can wait() to be woken by the next publish.
+class WorkChannel {
+ public:
+  WorkChannel();
+  // one writer at a time, sets work->epoch. The pool and long poll threads
+  // all publish, holding Miner::publishmu around Miner::publishWork.
+  void publish(const std::shared_ptr<Work> &work);
+  // how many times work was published. One relaxed load, so miner threads
+  // can check it every batch. 0 means no work yet.
+  uint64_t epoch() const { return seq.load(std::memory_order_relaxed); }
+  // the latest work, at least as new as epoch() was. nullptr before any.
+  // Not lock free: libstdc++'s atomic_load on a shared_ptr takes one of a
+  // small pool of mutexes, so call it once per new epoch, not per batch.
+  std::shared_ptr<const Work> read() const;
+  // sleep until the epoch is past `seen`, or `ms` went by. False on timeout.
+  bool wait(uint64_t seen, int ms) const;
+
+ private:
+  WorkChannel(const WorkChannel &);
+  WorkChannel &operator=(const WorkChannel &);
+  std::atomic<uint64_t> seq;            // epoch of `current`
+  std::shared_ptr<const Work> current;  // std::atomic_load/store only
+  mutable std::mutex waitmu;
+  mutable std::condition_variable waitcv;
+};
+
+class LatencyHistogram;
+
+// WorkSwitchClock times how long new work takes to reach every miner thread
+class WorkSwitchClock {
+ public:
+  // every switch is also counted in `histogram`, if not nullptr
+  WorkSwitchClock(uint8_t threads, LatencyHistogram *histogram);
+  // the publishing thread, right before publishing `epoch`
+  void published(uint64_t epoch);
+  // miner thread `thread_id` (1 based) started hashing `epoch`
+  void switched(uint8_t thread_id, uint64_t epoch);
+  // microseconds from publish until the last thread switched, for the
+  // latest work every thread has switched to. -1 before the first one.
+  long long latency() const { return lastLatency.load(); }
+
+ private:
+  WorkSwitchClock(const WorkSwitchClock &);
+  WorkSwitchClock &operator=(const WorkSwitchClock &);
+  struct Switch {
+    std::atomic<uint64_t> epoch;
+    std::atomic<long long> at;  // steady clock, microseconds
+  };
+  uint8_t numThreads;
+  std::atomic<uint64_t> publishedEpoch;
+  std::atomic<long long> publishedAt;
+  std::atomic<long long> lastLatency;
+  std::atomic<uint64_t> recordedEpoch;  // last one timed
+  std::unique_ptr<Switch[]> threadSwitch;
+  LatencyHistogram *histogram;
+};
+
+#endif  // M_WORK_H
@@ -24,48 +24,11 @@
 #include <cstdlib> /* strtoull */
 #include <cstring>
 
-void mpz_maxBest(mpz_t mpz_n) {
-  mpz_t mpz_two, mpz_exponent;
-  mpz_init_set_str(mpz_two, "2", 10);
-  mpz_init_set_str(mpz_exponent, "256", 10);
-  mpz_init_set_str(mpz_n, "0", 10);
-  mpz_pow_ui(mpz_n, mpz_two, mpz_get_ui(mpz_exponent));
-}
-
-// target = 2 ^ 256 / difficulty
-void computeTarget(mpz_t mpz_difficulty, mpz_t &mpz_target) {
-  mpz_t mpz_numerator;
-  mpz_maxBest(mpz_numerator);
-  mpz_init_set_str(mpz_target, "0", 10);
-  mpz_div(mpz_target, mpz_numerator, mpz_difficulty);
-}
-
-// difficulty = 2 ^ 256 / target
-void computeDifficulty(mpz_t mpz_target, mpz_t &mpz_difficulty) {
-  mpz_t mpz_numerator;
-  mpz_maxBest(mpz_numerator);
-  mpz_init_set_str(mpz_difficulty, "0", 10);
-  mpz_div(mpz_difficulty, mpz_numerator, mpz_target);
-}
-
-int char2int(char input) {
-  if (input >= '0' && input <= '9') return input - '0';
-  if (input >= 'A' && input <= 'F') return input - 'A' + 10;
-  if (input >= 'a' && input <= 'f') return input - 'a' + 10;
-  return -1;
-}
+#include "hexcodec.hpp" /* hexEncode, hexDecode */
 
 /* Adequate size s==len*2 + 1 must be alloced to use this variant */
 void __bin2hex(char *s, const unsigned char *p, size_t len) {
-  int i;
-  static const char hex[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
-                               '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-
-  for (i = 0; i < (int)len; i++) {
-    *s++ = hex[p[i] >> 4];
-    *s++ = hex[p[i] & 0xF];
-  }
-  *s++ = '\0';
+  hexEncode(s, p, len);
 }
 
 /* Returns a malloced array string of a binary value of arbitrary length. The
@@ -83,27 +46,25 @@ char *bin2hex(const unsigned char *p, size_t len) {
   return s;
 }
 
-void hex2bin(const char *src, uint8_t *target) {
-  while (*src && src[1]) {
-    *(target++) = char2int(*src) * 16 + char2int(src[1]);
-    src += 2;
-  }
+bool hex2bin(const char *src, uint8_t *target) {
+  return hexDecode(target, src, strlen(src));
 }
-void hex0x2bin(const char *src, uint8_t *target) {
-  src += 2;  // skip '0' and 'x'
-  while (*src && src[1]) {
-    *(target++) = char2int(*src) * 16 + char2int(src[1]);
-    src += 2;
-  }
+bool hex0x2bin(const char *src, uint8_t *target) {
+  return hexDecodeString(target, src);
 }
 void print_hex(const uint8_t *src, size_t len) {
-  char *hstr = bin2hex(src, len);
-  printf("%s\n", hstr);
-  free(hstr);
+  // a line at a time from the stack, no allocating
+  char hstr[2 * 64 + 1];
+  for (size_t i = 0; i < len; i += 64) {
+    size_t n = len - i < 64 ? len - i : 64;
+    hexEncode(hstr, src + i, n);
+    fputs(hstr, stdout);
+  }
+  putchar('\n');
 }
 
 void to_hex(const unsigned char *src, char *target, size_t len) {
-  __bin2hex(target, src, len);
+  hexEncode(target, src, len);
 }
 
 void mpz_fromBytesNoInit(uint8_t *bytes, size_t count, mpz_t mpz_result) {
@@ -118,6 +79,24 @@ void mpz_fromBytes(uint8_t *bytes, size_t count, mpz_t mpz_result) {
   mpz_fromBytesNoInit(bytes, count, mpz_result);
 }
 
+void targetToWords(mpz_t mpz_target, uint64_t words[4]) {
+  if (mpz_sizeinbase(mpz_target, 2) > 256) {
+    memset(words, 0xff, 4 * sizeof(uint64_t));
+    return;
+  }
+  uint64_t tmp[4] = {0, 0, 0, 0};
+  size_t count = 0;
+  mpz_export(tmp, &count, 1, sizeof(uint64_t), 0, 0, mpz_target);
+  // right align, mpz_export writes only the significant words
+  for (int i = 0; i < 4; i++) {
+    words[i] = i < 4 - static_cast<int>(count) ? 0 : tmp[i - (4 - count)];
+  }
+}
+
+void wordsToTarget(const uint64_t words[4], mpz_t mpz_target) {
+  mpz_import(mpz_target, 4, 1, sizeof(uint64_t), 0, 0, words);
+}
+
 std::string mpzToString(mpz_t num) {
   char buf[256];  // must be at least 64 (big numbers ...)
   int ret = gmp_snprintf(buf, sizeof(buf), "%Zd", num);
@@ -125,8 +104,12 @@ std::string mpzToString(mpz_t num) {
   return buf;
 }
 
-void decodeHex(const char *encoded, mpz_t mpz_res) {
+bool decodeHex(const char *encoded, mpz_t mpz_res) {
   auto pStart = encoded;
   if (strncmp(encoded, "0x", 2) == 0) pStart += 2;
-  mpz_init_set_str(mpz_res, pStart, 16);
+  if (mpz_set_str(mpz_res, pStart, 16) != 0) {
+    mpz_set_ui(mpz_res, 0);
+    return false;
+  }
+  return true;
 }
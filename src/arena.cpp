@@ -0,0 +1,150 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "arena.hpp"
+
+#include <aquahash.h>  // for ARGON2_OK, ARGON2_MEMORY_ALLOCATION_ERROR
+#include <string.h>    // for memset
+#include <sys/mman.h>  // for mmap, munmap, madvise
+
+#include <atomic>   // for atomic
+#include <fstream>  // for ifstream
+#include <string>   // for string
+
+static thread_local HashArena *boundArena = nullptr;
+static std::atomic<bool> useHugepages(false);
+
+const char *arena_pages_name(ArenaPages pages) {
+  switch (pages) {
+    case ARENA_PAGES_HUGETLB:
+      return "hugetlb";
+    case ARENA_PAGES_THP:
+      return "thp";
+    default:
+      return "normal";
+  }
+}
+
+void arena_use_hugepages(bool on) { useHugepages = on; }
+
+bool arena_hugepages() { return useHugepages; }
+
+// transparent huge pages are on, or on for madvise()d memory
+static bool thpAvailable() {
+  static const bool available = [] {
+    std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    std::getline(in, modes);
+    return !modes.empty() && modes.find("[never]") == std::string::npos;
+  }();
+  return available;
+}
+
+// `bytes` (whole huge pages) of huge page backed memory, as well as this
+// system allows
+static void *mapHuge(size_t bytes, ArenaPages *mode) {
+  void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    *mode = ARENA_PAGES_HUGETLB;
+    return p;
+  }
+  // no reserved huge pages: map 2 MiB aligned, so that the kernel can back
+  // it with transparent ones, and trim the slack
+  size_t span = bytes + ARENA_HUGE_PAGE;
+  p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0);
+  if (p == MAP_FAILED) {
+    return p;
+  }
+  const uintptr_t align = ARENA_HUGE_PAGE;
+  uintptr_t raw = reinterpret_cast<uintptr_t>(p);
+  uintptr_t start = (raw + align - 1) / align * align;
+  if (start > raw) {
+    munmap(p, start - raw);
+  }
+  if (raw + span > start + bytes) {
+    munmap(reinterpret_cast<void *>(start + bytes), raw + span - start - bytes);
+  }
+  p = reinterpret_cast<void *>(start);
+  *mode = thpAvailable() && madvise(p, bytes, MADV_HUGEPAGE) == 0
+              ? ARENA_PAGES_THP
+              : ARENA_PAGES_NORMAL;
+  return p;
+}
+
+HashArena::HashArena() {
+  mem = nullptr;
+  cap = 0;
+  mode = ARENA_PAGES_NORMAL;
+}
+
+HashArena::~HashArena() {
+  if (boundArena == this) boundArena = nullptr;
+  if (mem != nullptr) munmap(mem, cap);
+}
+
+bool HashArena::reserve(size_t bytes) {
+  if (bytes <= cap) {
+    return true;
+  }
+  // round up to whole pages, contents are not kept
+  const bool huge = useHugepages;
+  const size_t page = huge ? ARENA_HUGE_PAGE : ARENA_PAGE;
+  size_t want = (bytes + page - 1) / page * page;
+  // fresh pages, never heap memory another thread touched first: Linux
+  // puts a page on the NUMA node of the thread that first writes it, so
+  // an arena reserved by a pinned miner thread is local to its cpu
+  ArenaPages got = ARENA_PAGES_NORMAL;
+  void *p = huge ? mapHuge(want, &got)
+                 : mmap(nullptr, want, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  // fault the pages in now instead of on the first hash
+  memset(p, 0, want);
+  if (mem != nullptr) munmap(mem, cap);
+  mem = static_cast<uint8_t *>(p);
+  cap = want;
+  mode = got;
+  return true;
+}
+
+void HashArena::bind() { boundArena = this; }
+
+void HashArena::unbind() {
+  if (boundArena == this) boundArena = nullptr;
+}
+
+HashArena *HashArena::current() { return boundArena; }
+
+int arena_allocate(uint8_t **memory, size_t bytes_to_allocate) {
+  HashArena *arena = boundArena;
+  if (arena == nullptr || !arena->reserve(bytes_to_allocate)) {
+    *memory = nullptr;
+    return ARGON2_MEMORY_ALLOCATION_ERROR;
+  }
+  *memory = arena->data();
+  return ARGON2_OK;
+}
+
+void arena_deallocate(uint8_t *memory, size_t bytes_to_allocate) {
+  // arena memory lives as long as the thread's arena
+  (void)memory;
+  (void)bytes_to_allocate;
+}
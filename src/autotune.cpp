@@ -0,0 +1,232 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "autotune.hpp"
+
+#include <jsoncpp/json/reader.h>  // for CharReaderBuilder
+#include <jsoncpp/json/value.h>   // for Value
+#include <jsoncpp/json/writer.h>  // for StreamWriterBuilder
+#include <sys/stat.h>             // for mkdir
+
+#include <algorithm>  // for find, min
+#include <cstdlib>    // for getenv
+#include <fstream>    // for ifstream, ofstream
+#include <memory>     // for unique_ptr
+#include <sstream>    // for stringstream
+#include <vector>     // for vector
+
+#include "bench.hpp"     // for benchRate, cpuModel, BENCH_REFERENCE
+#include "engine.hpp"    // for aquahash_batch_select
+#include "topology.hpp"  // for cpuTopology, pinOrder
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#ifndef VERSION
+#define VERSION "0.0.0-unknown"
+#endif
+
+// a bigger setting has to win by this much (percent), otherwise the smaller
+// one stays: within the noise, fewer threads and shorter batches are better
+#define AUTOTUNE_MARGIN (1.0)
+
+namespace {
+
+// mkdir -p of everything before the last '/'
+void makeParents(const std::string &path) {
+  for (size_t i = 1; i < path.size(); i++) {
+    if (path[i] == '/') {
+      mkdir(path.substr(0, i).c_str(), 0755);
+    }
+  }
+}
+
+bool readCache(const std::string &path, Json::Value *doc) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  Json::CharReaderBuilder builder;
+  JSONCPP_STRING err;
+  return Json::parseFromStream(builder, in, doc, &err) && doc->isObject();
+}
+
+// thread counts worth trying: all of them on small hosts, a spread on big
+// ones
+std::vector<int> threadCandidates(int cpus) {
+  std::vector<int> counts;
+  if (cpus <= 8) {
+    for (int n = 1; n <= cpus; n++) {
+      counts.push_back(n);
+    }
+    return counts;
+  }
+  for (int n = 1; n < cpus / 2; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(cpus / 2);
+  counts.push_back(cpus * 3 / 4);
+  counts.push_back(cpus);
+  return counts;
+}
+
+}  // namespace
+
+std::string autotuneKey() {
+  return cpuModel() + " x" + std::to_string(onlineCpus());
+}
+
+std::string autotuneCachePath() {
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  const char *home = std::getenv("HOME");
+  std::string dir = xdg != nullptr && xdg[0] != 0
+                        ? std::string(xdg)
+                        : std::string(home != nullptr ? home : ".") +
+                              "/.cache";
+  return dir + "/aquaminer/autotune.json";
+}
+
+bool autotuneLoad(const std::string &path, const std::string &key,
+                  TuneResult *out) {
+  Json::Value doc;
+  if (!readCache(path, &doc) || !doc[key].isObject()) {
+    return false;
+  }
+  const Json::Value &entry = doc[key];
+  if (!entry["kernel"].isString() || !entry["threads"].isInt() ||
+      !entry["pinning"].isString() || !entry["batch"].isInt() ||
+      entry["threads"].asInt() < 1 || entry["batch"].asInt() < 1) {
+    return false;
+  }
+  out->kernel = entry["kernel"].asString();
+  out->threads = entry["threads"].asInt();
+  out->pinning = entry["pinning"].asString();
+  out->batch = entry["batch"].asInt();
+  out->rate = entry["rate"].asDouble();
+  return true;
+}
+
+bool autotuneSave(const std::string &path, const std::string &key,
+                  const TuneResult &result) {
+  Json::Value doc;
+  if (!readCache(path, &doc)) {
+    doc = Json::Value(Json::objectValue);
+  }
+  Json::Value entry;
+  entry["kernel"] = result.kernel;
+  entry["threads"] = result.threads;
+  entry["pinning"] = result.pinning;
+  entry["batch"] = result.batch;
+  entry["rate"] = result.rate;
+  entry["version"] = AUTOTUNE_VERSION;
+  entry["miner"] = VERSION;
+  doc[key] = entry;
+  makeParents(path);
+  std::ofstream out(path);
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "  ";
+  out << Json::writeString(writer, doc) << std::endl;
+  return out.good();
+}
+
+TuneResult autotune(double seconds) {
+  auto logger = spdlog::stderr_color_mt("AUTOTUNE");
+  const double warmup = seconds / 2;
+  const int trials = 3;
+  BenchResult job;
+  job.version = AUTOTUNE_VERSION;
+  job.threads = 1;
+  job.pinning = PIN_NONE;
+  TuneResult best;
+  best.threads = 1;
+  best.pinning = PIN_NONE;
+  best.batch = 1;
+  best.rate = 0;
+
+  // kernel, one thread: the widest isn't always fastest (clocks, ports)
+  std::stringstream kernels(aquahash_batch_kernels());
+  for (std::string k; kernels >> k;) {
+    if (!aquahash_batch_select(k) || !aquahash_batch_selftest()) {
+      continue;
+    }
+    job.kernel = k;
+    job.batch = aquahash_batch_width();
+    double rate = benchRate(&job, warmup, seconds, trials);
+    logger->info("kernel {}: {:.1f} H/s", k, rate);
+    if (rate > best.rate) {
+      best.kernel = k;
+      best.rate = rate;
+    }
+  }
+  // none hashed right: the miner falls back to libaquahash, so tune that.
+  // best.kernel stays empty, so this result doesn't get cached.
+  const bool reference = best.kernel.empty();
+  if (reference) {
+    logger->warn("no kernel passed its selftest, tuning the reference");
+    aquahash_batch_select("auto");
+  } else {
+    aquahash_batch_select(best.kernel);
+  }
+  const size_t width = reference ? 1 : aquahash_batch_width();
+  job.kernel = reference ? BENCH_REFERENCE : best.kernel;
+  job.batch = width;
+
+  // threads, where the caches run out
+  best.rate = 0;
+  for (int n : threadCandidates(onlineCpus())) {
+    job.threads = n;
+    double rate = benchRate(&job, warmup, seconds, trials);
+    logger->info("{} threads: {:.1f} H/s", n, rate);
+    if (rate > best.rate * (1 + AUTOTUNE_MARGIN / 100)) {
+      best.threads = n;
+      best.rate = rate;
+    }
+  }
+  job.threads = best.threads;
+
+  // pinning, skipping policies that come out the same as one already tried
+  const char *policies[] = {PIN_COMPACT, PIN_SCATTER, PIN_CORES};
+  std::vector<CpuInfo> cpus = cpuTopology();
+  std::vector<std::vector<int>> tried;
+  for (const char *policy : policies) {
+    std::vector<int> order = pinOrder(policy, cpus);
+    order.resize(std::min(order.size(), static_cast<size_t>(job.threads)));
+    if (std::find(tried.begin(), tried.end(), order) != tried.end()) {
+      continue;
+    }
+    tried.push_back(order);
+    job.pinning = policy;
+    double rate = benchRate(&job, warmup, seconds, trials);
+    logger->info("{} threads pinned {}: {:.1f} H/s", job.threads, policy,
+                 rate);
+    if (rate > best.rate * (1 + AUTOTUNE_MARGIN / 100)) {
+      best.pinning = policy;
+      best.rate = rate;
+    }
+  }
+  job.pinning = best.pinning;
+
+  // batch, more nonces per call
+  for (int b = 2; b <= 4; b *= 2) {
+    job.batch = width * b;
+    double rate = benchRate(&job, warmup, seconds, trials);
+    logger->info("batch {}: {:.1f} H/s", job.batch, rate);
+    if (rate > best.rate * (1 + AUTOTUNE_MARGIN / 100)) {
+      best.batch = b;
+      best.rate = rate;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,416 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "bench.hpp"
+
+#include <jsoncpp/json/value.h>   // for Value
+#include <jsoncpp/json/writer.h>  // for StreamWriterBuilder
+#include <linux/perf_event.h>     // for perf_event_attr
+#include <string.h>               // for memcpy, memset
+#include <sys/ioctl.h>            // for ioctl
+#include <sys/syscall.h>          // for SYS_perf_event_open
+#include <unistd.h>               // for syscall, read, close
+
+#include <algorithm>  // for sort, max
+#include <atomic>     // for atomic
+#include <chrono>     // for steady_clock
+#include <cmath>      // for sqrt, ceil
+#include <cstdio>     // for printf
+#include <cstdlib>    // for strtol
+#include <fstream>    // for ifstream
+#include <iostream>   // for cout
+#include <random>     // for random_device
+#include <sstream>    // for stringstream
+#include <thread>     // for thread
+
+#include "aqua.hpp"      // for HASH_LEN, HASH_INPUT_LEN
+#include "arena.hpp"     // for HashArena
+#include "engine.hpp"    // for aquahash_batch_nonces
+#include "topology.hpp"  // for pinOrder, pinThread
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#ifndef VERSION
+#define VERSION "0.0.0-unknown"
+#endif
+
+int aquahash_version(void *out, const void *in, uint32_t mem);
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+// what one thread did in one trial
+struct BenchThread {
+  uint64_t hashes;
+  Clock::time_point end;
+  std::vector<double> latencies;  // us per hash, one per call
+  int64_t dtlbMisses;             // -1 if they couldn't be counted
+  ArenaPages pages;
+};
+
+// the latency samples a thread keeps per trial, plenty for a p99
+const size_t maxSamples = 1 << 16;
+
+uint32_t versionMem(int version) {
+  switch (version) {
+    case 2:
+      return 1;
+    case 3:
+      return 16;
+    case 4:
+      return 32;
+  }
+  return 0;
+}
+
+// a counter of the calling thread's dTLB load misses in user space, -1 if
+// perf events aren't allowed (perf_event_paranoid, containers, some VMs)
+int openDtlbCounter() {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// hash until `stop`, counting batches that finished
+void benchWorker(const BenchResult *job, uint32_t mem, int cpu,
+                 std::atomic<int> *ready, const std::atomic<bool> *go,
+                 const std::atomic<bool> *stop, BenchThread *result) {
+  const bool reference = job->kernel == BENCH_REFERENCE;
+  if (cpu >= 0) {
+    pinThread(cpu);
+  }
+  HashArena arena;
+  if (!arena.reserve(reference ? aquahash_memsize(mem)
+                               : aquahash_batch_memsize(mem))) {
+    result->hashes = 0;
+    ready->fetch_add(1);
+    return;
+  }
+  arena.bind();
+  result->pages = arena.pages();
+  const size_t n = job->batch;
+  std::vector<uint8_t> in(n * HASH_INPUT_LEN);
+  std::vector<uint8_t> out(n * HASH_LEN);
+  std::random_device rd;
+  for (size_t i = 0; i < in.size(); i++) {
+    in[i] = static_cast<uint8_t>(rd());
+  }
+  // same hot path as the miner: H0 midstate once per job
+  AquahashMidstate mid;
+  aquahash_midstate(&mid, in.data(), mem);
+  uint64_t nonce = 0;
+  result->hashes = 0;
+  result->latencies.reserve(maxSamples);
+  ready->fetch_add(1);
+  int dtlb = openDtlbCounter();
+  while (!go->load()) {
+    std::this_thread::yield();
+  }
+  if (dtlb >= 0) {
+    ioctl(dtlb, PERF_EVENT_IOC_RESET, 0);
+    ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  while (!stop->load(std::memory_order_relaxed)) {
+    auto t1 = Clock::now();
+    if (reference) {
+      for (size_t k = 0; k < n; k++) {
+        uint64_t lane_nonce = nonce + k;
+        memcpy(&in[k * HASH_INPUT_LEN + 32], &lane_nonce, 8);
+        aquahash_version(&out[k * HASH_LEN], &in[k * HASH_INPUT_LEN], mem);
+      }
+    } else {
+      aquahash_batch_nonces(out.data(), mid, nonce, n, arena.data());
+    }
+    auto t2 = Clock::now();
+    nonce += n;
+    result->hashes += n;
+    if (result->latencies.size() < maxSamples) {
+      std::chrono::duration<double, std::micro> us = t2 - t1;
+      result->latencies.push_back(us.count() / n);
+    }
+  }
+  result->end = Clock::now();
+  result->dtlbMisses = -1;
+  if (dtlb >= 0) {
+    ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t misses;
+    if (read(dtlb, &misses, sizeof(misses)) == sizeof(misses)) {
+      result->dtlbMisses = static_cast<int64_t>(misses);
+    }
+    close(dtlb);
+  }
+  arena.unbind();
+}
+
+// hashes per second of `threads` threads over `seconds`. If `record`,
+// the latencies and dTLB misses per hash go into `job` too.
+double trial(BenchResult *job, uint32_t mem, double seconds, bool record) {
+  std::vector<BenchThread> results(job->threads);
+  std::vector<std::thread> threads;
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false), stop(false);
+  std::vector<int> cpus = pinOrder(job->pinning, cpuTopology());
+  for (int i = 0; i < job->threads; i++) {
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    threads.push_back(std::thread(benchWorker, job, mem, cpu, &ready, &go,
+                                  &stop, &results[i]));
+  }
+  // arenas are set up before the clock starts
+  while (ready.load() < job->threads) {
+    std::this_thread::yield();
+  }
+  auto start = Clock::now();
+  go = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  uint64_t hashes = 0;
+  int64_t misses = 0;
+  Clock::time_point end = start;
+  for (int i = 0; i < job->threads; i++) {
+    threads[i].join();
+    hashes += results[i].hashes;
+    end = std::max(end, results[i].end);
+    misses = results[i].dtlbMisses < 0 || misses < 0
+                 ? -1
+                 : misses + results[i].dtlbMisses;
+  }
+  if (record) {
+    for (const BenchThread &r : results) {
+      job->latencies.insert(job->latencies.end(), r.latencies.begin(),
+                            r.latencies.end());
+    }
+    if (misses >= 0 && hashes > 0) {
+      job->dtlbMisses.push_back(static_cast<double>(misses) / hashes);
+    }
+    job->pages = arena_pages_name(results[0].pages);
+  }
+  std::chrono::duration<double> dur = end - start;
+  return dur.count() > 0 ? hashes / dur.count() : 0;
+}
+
+// nearest rank percentile, p in 0..100
+double percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t rank = static_cast<size_t>(std::ceil(p / 100 * v.size()));
+  return v[rank == 0 ? 0 : rank - 1];
+}
+
+// standard deviation as a percentage of the mean
+double spread(const std::vector<double> &v) {
+  if (v.size() < 2) {
+    return 0;
+  }
+  double mean = 0;
+  for (double x : v) {
+    mean += x;
+  }
+  mean /= v.size();
+  double var = 0;
+  for (double x : v) {
+    var += (x - mean) * (x - mean);
+  }
+  var /= v.size() - 1;
+  return mean > 0 ? std::sqrt(var) / mean * 100 : 0;
+}
+
+// median dTLB misses per hash, `none` if perf couldn't count them
+std::string dtlbText(const BenchResult &r, const char *none) {
+  if (r.dtlbMisses.empty()) {
+    return none;
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", percentile(r.dtlbMisses, 50));
+  return buf;
+}
+
+void printText(const std::vector<BenchResult> &results) {
+  printf("%-7s %-9s %5s %7s %-7s %12s %12s %12s %7s %9s %9s %8s\n",
+         "version", "kernel", "batch", "threads", "pages", "median H/s",
+         "min H/s", "max H/s", "stddev", "p50 us/H", "p99 us/H", "dTLB/H");
+  for (const BenchResult &r : results) {
+    printf(
+        "%-7d %-9s %5zu %7d %-7s %12.1f %12.1f %12.1f %6.2f%% %9.2f %9.2f "
+        "%8s\n",
+        r.version, r.kernel.c_str(), r.batch, r.threads, r.pages.c_str(),
+        percentile(r.rates, 50), percentile(r.rates, 0),
+        percentile(r.rates, 100), spread(r.rates),
+        percentile(r.latencies, 50), percentile(r.latencies, 99),
+        dtlbText(r, "n/a").c_str());
+  }
+}
+
+void printCsv(const std::vector<BenchResult> &results) {
+  printf(
+      "version,kernel,batch,threads,pages,trials,median_hs,min_hs,max_hs,"
+      "stddev_pct,p50_us,p99_us,dtlb_per_hash\n");
+  for (const BenchResult &r : results) {
+    printf("%d,%s,%zu,%d,%s,%zu,%.1f,%.1f,%.1f,%.2f,%.3f,%.3f,%s\n",
+           r.version, r.kernel.c_str(), r.batch, r.threads, r.pages.c_str(),
+           r.rates.size(), percentile(r.rates, 50), percentile(r.rates, 0),
+           percentile(r.rates, 100), spread(r.rates),
+           percentile(r.latencies, 50), percentile(r.latencies, 99),
+           dtlbText(r, "").c_str());
+  }
+}
+
+void printJson(const BenchConfig &cfg,
+               const std::vector<BenchResult> &results) {
+  Json::Value doc;
+  doc["miner"] = VERSION;
+  doc["cpu"] = cpuModel();
+  doc["cpus"] = std::thread::hardware_concurrency();
+  doc["trials"] = cfg.trials;
+  doc["seconds"] = cfg.seconds;
+  doc["warmup"] = cfg.warmup;
+  doc["results"] = Json::Value(Json::arrayValue);
+  for (const BenchResult &r : results) {
+    Json::Value row;
+    row["version"] = r.version;
+    row["kernel"] = r.kernel;
+    row["batch"] = static_cast<Json::UInt64>(r.batch);
+    row["threads"] = r.threads;
+    row["pages"] = r.pages;
+    row["rates"] = Json::Value(Json::arrayValue);
+    for (double rate : r.rates) {
+      row["rates"].append(rate);
+    }
+    row["median"] = percentile(r.rates, 50);
+    row["min"] = percentile(r.rates, 0);
+    row["max"] = percentile(r.rates, 100);
+    row["stddev_pct"] = spread(r.rates);
+    row["p50_us"] = percentile(r.latencies, 50);
+    row["p99_us"] = percentile(r.latencies, 99);
+    row["dtlb_per_hash"] = r.dtlbMisses.empty()
+                               ? Json::Value()
+                               : Json::Value(percentile(r.dtlbMisses, 50));
+    doc["results"].append(row);
+  }
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "  ";
+  std::cout << Json::writeString(writer, doc) << std::endl;
+}
+
+}  // namespace
+
+double benchRate(BenchResult *job, double warmup, double seconds,
+                 int trials) {
+  uint32_t mem = versionMem(job->version);
+  job->rates.clear();
+  job->latencies.clear();
+  job->dtlbMisses.clear();
+  if (warmup > 0) {
+    trial(job, mem, warmup, false);
+  }
+  for (int t = 0; t < trials; t++) {
+    job->rates.push_back(trial(job, mem, seconds, true));
+  }
+  return percentile(job->rates, 50);
+}
+
+bool parseBenchList(const std::string &list, std::vector<int> *out) {
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    char *end = nullptr;
+    long v = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != 0 || v <= 0) {
+      return false;
+    }
+    out->push_back(static_cast<int>(v));
+  }
+  return !out->empty();
+}
+
+std::string cpuModel() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos && colon + 2 <= line.size()) {
+        return line.substr(colon + 2);
+      }
+    }
+  }
+  return "unknown";
+}
+
+int runBenchSuite(const BenchConfig &cfg) {
+  auto logger = spdlog::stderr_color_mt("BENCH");
+  std::vector<BenchResult> results;
+  for (const std::string &kernel : cfg.kernels) {
+    size_t width = 1;
+    if (kernel != BENCH_REFERENCE) {
+      if (!aquahash_batch_select(kernel)) {
+        logger->error("kernel {} is unknown or unsupported on this cpu",
+                      kernel);
+        return 111;
+      }
+      // a fast wrong kernel is no use, check it before timing it
+      if (!aquahash_batch_selftest()) {
+        logger->error("kernel {} hashes wrong, not benchmarking it", kernel);
+        return 111;
+      }
+      width = aquahash_batch_width();
+    }
+    for (int version : cfg.versions) {
+      uint32_t mem = versionMem(version);
+      if (mem == 0) {
+        logger->error("no aquahash version {}", version);
+        return 111;
+      }
+      for (int batch : cfg.batches) {
+        for (int threads : cfg.threads) {
+          // normal pages, then huge pages right after for comparison
+          for (int huge = 0; huge <= (cfg.hugepages ? 1 : 0); huge++) {
+            arena_use_hugepages(huge != 0);
+            BenchResult r;
+            r.version = version;
+            r.kernel = kernel;
+            r.batch = batch * width;
+            r.threads = threads;
+            r.pinning = PIN_NONE;
+            logger->info("v{} {} batch {} threads {}{}", version, kernel,
+                         r.batch, threads, huge ? " hugepages" : "");
+            benchRate(&r, cfg.warmup, cfg.seconds, cfg.trials);
+            results.push_back(r);
+          }
+        }
+      }
+    }
+  }
+  aquahash_batch_select("auto");
+  if (cfg.format == "json") {
+    printJson(cfg, results);
+  } else if (cfg.format == "csv") {
+    printCsv(results);
+  } else {
+    printText(results);
+  }
+  return 0;
+}
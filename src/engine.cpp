@@ -0,0 +1,545 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "engine.hpp"
+
+#include <aquahash.h>  // for ARGON2_OK, ARGON2_VERSION_13, Argon2_id
+#include <stdint.h>    // for uint64_t
+#include <stdlib.h>    // for posix_memalign, free
+#include <string.h>    // for memcpy, memcmp
+#include <unistd.h>    // for sysconf
+
+#include <string>  // for string
+#include <vector>  // for vector
+
+// With gcc on x86 every kernel is built into the binary, each in its own
+// `#pragma GCC target` region, and the cpu picks at run time. Otherwise
+// only what the compiler flags allow is built in.
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define ENGINE_MULTIARCH
+#endif
+#if defined(ENGINE_MULTIARCH) || defined(__SSE2__)
+#define ENGINE_SSE2
+#endif
+#if defined(ENGINE_MULTIARCH) || defined(__AVX2__)
+#define ENGINE_AVX2
+#endif
+#if defined(ENGINE_MULTIARCH) || defined(__AVX512F__)
+#define ENGINE_AVX512
+#endif
+
+#if defined(ENGINE_SSE2) || defined(ENGINE_AVX2) || defined(ENGINE_AVX512)
+// gcc 12's avx512 intrinsics warn about their own _mm512_undefined_*()
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
+#include "aqua.hpp"   // for HASH_LEN, HASH_INPUT_LEN
+#include "arena.hpp"  // for aquahash_memsize
+
+#define ARGON2_QWORDS (128)  // 64-bit words in a 1 KiB block
+#define ARGON2_SLICES (4)    // ARGON2_SYNC_POINTS
+
+#define FORCE_INLINE inline __attribute__((always_inline))
+
+int aquahash_version(void *output, const void *input, uint32_t mem);
+
+namespace {
+
+const uint64_t blake2b_IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+const uint8_t blake2b_sigma[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+// argon2 memory blocks used at m_cost `mem`
+inline uint32_t memory_blocks(uint32_t mem) {
+  return static_cast<uint32_t>(aquahash_memsize(mem) / 1024);
+}
+
+// argon2 index_alpha for the first (and only) pass: the block to reference
+// out of the `area` blocks before the current one
+inline uint32_t index_alpha(uint64_t pseudo_rand, uint32_t area) {
+  uint64_t rel = pseudo_rand & 0xffffffff;
+  rel = (rel * rel) >> 32;
+  return area - 1 - static_cast<uint32_t>((area * rel) >> 32);
+}
+
+const uint32_t *independent_refs(uint32_t blocks);
+
+// the one BLAKE2b block H0 hashes: argon2 parameters, the 40 byte input,
+// then zero salt, secret and ad lengths
+void h0_message(uint64_t m[16], const uint8_t *in, uint32_t mem) {
+  uint32_t params[7] = {1,
+                        HASH_LEN,
+                        mem,
+                        1,
+                        ARGON2_VERSION_13,
+                        Argon2_id,
+                        HASH_INPUT_LEN};
+  uint8_t buf[128] = {0};
+  memcpy(buf, params, sizeof(params));
+  memcpy(buf + sizeof(params), in, HASH_INPUT_LEN);
+  memcpy(m, buf, sizeof(buf));
+}
+
+// Lane types: `reg` holds the same 64-bit word of `width` different hashes.
+
+struct Lanes1 {
+  typedef uint64_t reg;
+  static const size_t width = 1;
+  static FORCE_INLINE reg load(const uint64_t *p) { return *p; }
+  static FORCE_INLINE void store(uint64_t *p, reg a) { *p = a; }
+  static FORCE_INLINE reg set1(uint64_t x) { return x; }
+  static FORCE_INLINE reg add(reg a, reg b) { return a + b; }
+  static FORCE_INLINE reg xor_(reg a, reg b) { return a ^ b; }
+  static FORCE_INLINE reg shl32(reg a) { return a << 32; }
+  static FORCE_INLINE reg shr32(reg a) { return a >> 32; }
+  static FORCE_INLINE reg fBlaMka(reg a, reg b) {
+    return a + b + 2 * (a & 0xffffffff) * (b & 0xffffffff);
+  }
+  static FORCE_INLINE reg rotr32(reg a) { return (a >> 32) | (a << 32); }
+  static FORCE_INLINE reg rotr24(reg a) { return (a >> 24) | (a << 40); }
+  static FORCE_INLINE reg rotr16(reg a) { return (a >> 16) | (a << 48); }
+  static FORCE_INLINE reg rotr63(reg a) { return (a >> 63) | (a << 1); }
+  static FORCE_INLINE reg gather(const uint64_t *base, const uint64_t *off) {
+    return base[off[0]];
+  }
+};
+
+namespace generic {
+#include "engine_kernel.hpp"
+void hash(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory) {
+  batch_hash_any<Lanes1>(out, in, mem, memory);
+}
+AquahashNoncesFn hash_nonces(uint32_t mem) {
+  return batch_hash_nonces_for<Lanes1>(mem);
+}
+}  // namespace generic
+
+// Reference blocks of the data independent slices (0 and 1). They depend
+// only on the block count, so each thread works them out once per version.
+const uint32_t *independent_refs(uint32_t blocks) {
+  static thread_local uint32_t cachedBlocks = 0;
+  static thread_local std::vector<uint32_t> refs;
+  if (cachedBlocks == blocks) {
+    return refs.data();
+  }
+  refs.assign(blocks, 0);
+  const uint32_t seg = blocks / ARGON2_SLICES;
+  uint64_t zero[ARGON2_QWORDS] = {0};
+  for (uint32_t s = 0; s < 2; s++) {
+    uint64_t input[ARGON2_QWORDS] = {0};
+    uint64_t addresses[ARGON2_QWORDS];
+    input[2] = s;       // slice
+    input[3] = blocks;  // memory blocks
+    input[4] = 1;       // passes
+    input[5] = Argon2_id;
+    const uint32_t start = s == 0 ? 2 : 0;
+    for (uint32_t i = start; i < seg; i++) {
+      // a fresh block of addresses every ARGON2_QWORDS blocks, like
+      // argon2's next_addresses
+      if (i == start || i % ARGON2_QWORDS == 0) {
+        input[6]++;  // address block counter
+        generic::DirectRef<Lanes1> in = {input};
+        generic::fill_block<Lanes1>(zero, in, addresses);
+        generic::DirectRef<Lanes1> addr = {addresses};
+        generic::fill_block<Lanes1>(zero, addr, addresses);
+      }
+      uint32_t area = s * seg + i - 1;
+      refs[s * seg + i] = index_alpha(addresses[i % ARGON2_QWORDS], area);
+    }
+  }
+  cachedBlocks = blocks;
+  return refs.data();
+}
+
+#if defined(ENGINE_SSE2)
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+
+struct Lanes2 {
+  typedef __m128i reg;
+  static const size_t width = 2;
+  static FORCE_INLINE reg load(const uint64_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+  static FORCE_INLINE void store(uint64_t *p, reg a) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a);
+  }
+  static FORCE_INLINE reg set1(uint64_t x) {
+    return _mm_set1_epi64x(static_cast<long long>(x));
+  }
+  static FORCE_INLINE reg add(reg a, reg b) { return _mm_add_epi64(a, b); }
+  static FORCE_INLINE reg xor_(reg a, reg b) { return _mm_xor_si128(a, b); }
+  static FORCE_INLINE reg shl32(reg a) { return _mm_slli_epi64(a, 32); }
+  static FORCE_INLINE reg shr32(reg a) { return _mm_srli_epi64(a, 32); }
+  static FORCE_INLINE reg fBlaMka(reg a, reg b) {
+    reg ml = _mm_mul_epu32(a, b);
+    return _mm_add_epi64(_mm_add_epi64(a, b), _mm_add_epi64(ml, ml));
+  }
+  static FORCE_INLINE reg rotr32(reg a) {
+    return _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
+  }
+  static FORCE_INLINE reg rotr24(reg a) {
+    return _mm_or_si128(_mm_srli_epi64(a, 24), _mm_slli_epi64(a, 40));
+  }
+  static FORCE_INLINE reg rotr16(reg a) {
+    return _mm_or_si128(_mm_srli_epi64(a, 16), _mm_slli_epi64(a, 48));
+  }
+  static FORCE_INLINE reg rotr63(reg a) {
+    return _mm_xor_si128(_mm_srli_epi64(a, 63), _mm_add_epi64(a, a));
+  }
+  static FORCE_INLINE reg gather(const uint64_t *base, const uint64_t *off) {
+    return _mm_set_epi64x(static_cast<long long>(base[off[1]]),
+                          static_cast<long long>(base[off[0]]));
+  }
+};
+
+namespace sse2 {
+#include "engine_kernel.hpp"
+void hash(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory) {
+  batch_hash_any<Lanes2>(out, in, mem, memory);
+}
+AquahashNoncesFn hash_nonces(uint32_t mem) {
+  return batch_hash_nonces_for<Lanes2>(mem);
+}
+}  // namespace sse2
+
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC pop_options
+#endif
+#endif  // ENGINE_SSE2
+
+#if defined(ENGINE_AVX2)
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+struct Lanes4 {
+  typedef __m256i reg;
+  static const size_t width = 4;
+  static FORCE_INLINE reg load(const uint64_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  static FORCE_INLINE void store(uint64_t *p, reg a) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a);
+  }
+  static FORCE_INLINE reg set1(uint64_t x) {
+    return _mm256_set1_epi64x(static_cast<long long>(x));
+  }
+  static FORCE_INLINE reg add(reg a, reg b) { return _mm256_add_epi64(a, b); }
+  static FORCE_INLINE reg xor_(reg a, reg b) {
+    return _mm256_xor_si256(a, b);
+  }
+  static FORCE_INLINE reg shl32(reg a) { return _mm256_slli_epi64(a, 32); }
+  static FORCE_INLINE reg shr32(reg a) { return _mm256_srli_epi64(a, 32); }
+  static FORCE_INLINE reg fBlaMka(reg a, reg b) {
+    reg ml = _mm256_mul_epu32(a, b);
+    return _mm256_add_epi64(_mm256_add_epi64(a, b), _mm256_add_epi64(ml, ml));
+  }
+  static FORCE_INLINE reg rotr32(reg a) {
+    return _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
+  }
+  static FORCE_INLINE reg rotr24(reg a) {
+    return _mm256_shuffle_epi8(
+        a, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9,
+                            10, 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8,
+                            9, 10));
+  }
+  static FORCE_INLINE reg rotr16(reg a) {
+    return _mm256_shuffle_epi8(
+        a, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8,
+                            9, 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15,
+                            8, 9));
+  }
+  static FORCE_INLINE reg rotr63(reg a) {
+    return _mm256_xor_si256(_mm256_srli_epi64(a, 63), _mm256_add_epi64(a, a));
+  }
+  static FORCE_INLINE reg gather(const uint64_t *base, const uint64_t *off) {
+    return _mm256_i64gather_epi64(
+        reinterpret_cast<const long long *>(base),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(off)), 8);
+  }
+};
+
+namespace avx2 {
+#include "engine_kernel.hpp"
+void hash(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory) {
+  batch_hash_any<Lanes4>(out, in, mem, memory);
+}
+AquahashNoncesFn hash_nonces(uint32_t mem) {
+  return batch_hash_nonces_for<Lanes4>(mem);
+}
+}  // namespace avx2
+
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC pop_options
+#endif
+#endif  // ENGINE_AVX2
+
+#if defined(ENGINE_AVX512)
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+struct Lanes8 {
+  typedef __m512i reg;
+  static const size_t width = 8;
+  static FORCE_INLINE reg load(const uint64_t *p) {
+    return _mm512_loadu_si512(p);
+  }
+  static FORCE_INLINE void store(uint64_t *p, reg a) {
+    _mm512_storeu_si512(p, a);
+  }
+  static FORCE_INLINE reg set1(uint64_t x) {
+    return _mm512_set1_epi64(static_cast<long long>(x));
+  }
+  static FORCE_INLINE reg add(reg a, reg b) { return _mm512_add_epi64(a, b); }
+  static FORCE_INLINE reg xor_(reg a, reg b) {
+    return _mm512_xor_si512(a, b);
+  }
+  static FORCE_INLINE reg shl32(reg a) { return _mm512_slli_epi64(a, 32); }
+  static FORCE_INLINE reg shr32(reg a) { return _mm512_srli_epi64(a, 32); }
+  static FORCE_INLINE reg fBlaMka(reg a, reg b) {
+    reg ml = _mm512_mul_epu32(a, b);
+    return _mm512_add_epi64(_mm512_add_epi64(a, b), _mm512_add_epi64(ml, ml));
+  }
+  static FORCE_INLINE reg rotr32(reg a) { return _mm512_ror_epi64(a, 32); }
+  static FORCE_INLINE reg rotr24(reg a) { return _mm512_ror_epi64(a, 24); }
+  static FORCE_INLINE reg rotr16(reg a) { return _mm512_ror_epi64(a, 16); }
+  static FORCE_INLINE reg rotr63(reg a) { return _mm512_ror_epi64(a, 63); }
+  static FORCE_INLINE reg gather(const uint64_t *base, const uint64_t *off) {
+    return _mm512_i64gather_epi64(_mm512_loadu_si512(off), base, 8);
+  }
+};
+
+namespace avx512 {
+#include "engine_kernel.hpp"
+void hash(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory) {
+  batch_hash_any<Lanes8>(out, in, mem, memory);
+}
+AquahashNoncesFn hash_nonces(uint32_t mem) {
+  return batch_hash_nonces_for<Lanes8>(mem);
+}
+}  // namespace avx512
+
+#if defined(ENGINE_MULTIARCH)
+#pragma GCC pop_options
+#endif
+#endif  // ENGINE_AVX512
+
+// cpu feature checks for the kernel table
+bool cpu_generic() { return true; }
+#if defined(ENGINE_SSE2)
+bool cpu_sse2() { return __builtin_cpu_supports("sse2"); }
+#endif
+#if defined(ENGINE_AVX2)
+bool cpu_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+#if defined(ENGINE_AVX512)
+bool cpu_avx512() { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+struct Kernel {
+  const char *name;
+  size_t width;
+  void (*hash)(uint8_t *out, const uint8_t *in, uint32_t mem, void *memory);
+  AquahashNoncesFn (*hashNonces)(uint32_t mem);
+  bool (*supported)();
+};
+
+// dispatch table, widest first
+const Kernel kernels[] = {
+#if defined(ENGINE_AVX512)
+    {"avx512", Lanes8::width, avx512::hash, avx512::hash_nonces,
+     cpu_avx512},
+#endif
+#if defined(ENGINE_AVX2)
+    {"avx2", Lanes4::width, avx2::hash, avx2::hash_nonces, cpu_avx2},
+#endif
+#if defined(ENGINE_SSE2)
+    {"sse2", Lanes2::width, sse2::hash, sse2::hash_nonces, cpu_sse2},
+#endif
+    {"generic", Lanes1::width, generic::hash, generic::hash_nonces,
+     cpu_generic},
+};
+const size_t numKernels = sizeof(kernels) / sizeof(kernels[0]);
+
+// The widest kernel this cpu runs, unless a v4 batch of it would not fit in
+// half of L2, in which case the widest one that does.
+const Kernel *pick_kernel() {
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  for (size_t i = 0; i + 1 < numKernels; i++) {
+    if (!kernels[i].supported()) {
+      continue;
+    }
+    size_t batch = aquahash_memsize(32) * kernels[i].width;
+    if (l2 <= 0 || batch <= static_cast<size_t>(l2) / 2) {
+      return &kernels[i];
+    }
+  }
+  return &kernels[numKernels - 1];
+}
+
+// set by aquahash_batch_select(), before any hashing starts
+const Kernel *forcedKernel = nullptr;
+
+const Kernel *kernel() {
+  if (forcedKernel != nullptr) {
+    return forcedKernel;
+  }
+  static const Kernel *k = pick_kernel();
+  return k;
+}
+
+}  // namespace
+
+int aquahash_batch(uint8_t *out, const uint8_t *in, size_t count,
+                   uint32_t mem, void *memory) {
+  const Kernel *k = kernel();
+  size_t i = 0;
+  for (; i + k->width <= count; i += k->width) {
+    k->hash(out + i * HASH_LEN, in + i * HASH_INPUT_LEN, mem, memory);
+  }
+  // leftovers one at a time
+  for (; i < count; i++) {
+    generic::hash(out + i * HASH_LEN, in + i * HASH_INPUT_LEN, mem, memory);
+  }
+  return ARGON2_OK;
+}
+
+void aquahash_midstate(AquahashMidstate *mid, const uint8_t *prefix,
+                       uint32_t mem) {
+  uint8_t in[HASH_INPUT_LEN] = {0};
+  memcpy(in, prefix, 32);
+  mid->mem = mem;
+  h0_message(mid->m, in, mem);
+  generic::h0_midstate<Lanes1>(mid->v, mid->m);
+  const Kernel *k = kernel();
+  mid->width = k->width;
+  mid->hash = k->hashNonces(mem);
+  mid->hashOne = generic::hash_nonces(mem);
+}
+
+int aquahash_batch_nonces(uint8_t *out, const AquahashMidstate &mid,
+                          uint64_t nonce, size_t count, void *memory) {
+  size_t i = 0;
+  for (; i + mid.width <= count; i += mid.width) {
+    mid.hash(out + i * HASH_LEN, mid, nonce + i, memory);
+  }
+  // leftovers one at a time
+  for (; i < count; i++) {
+    mid.hashOne(out + i * HASH_LEN, mid, nonce + i, memory);
+  }
+  return ARGON2_OK;
+}
+
+size_t aquahash_batch_memsize(uint32_t mem) {
+  return aquahash_memsize(mem) * kernel()->width;
+}
+
+size_t aquahash_batch_width() { return kernel()->width; }
+
+const char *aquahash_batch_isa() { return kernel()->name; }
+
+bool aquahash_batch_select(const std::string &name) {
+  if (name == "auto") {
+    forcedKernel = nullptr;
+    return true;
+  }
+  for (size_t i = 0; i < numKernels; i++) {
+    if (name == kernels[i].name && kernels[i].supported()) {
+      forcedKernel = &kernels[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string aquahash_batch_kernels() {
+  std::string names;
+  for (size_t i = 0; i < numKernels; i++) {
+    if (kernels[i].supported()) {
+      names += names.empty() ? "" : " ";
+      names += kernels[i].name;
+    }
+  }
+  return names;
+}
+
+bool aquahash_batch_selftest() {
+  const uint32_t mems[3] = {1, 16, 32};  // Aquahash v2, v3, v4
+  const size_t n = AQUAHASH_MAX_LANES + 1;
+  uint8_t in[n * HASH_INPUT_LEN];
+  uint8_t out[n * HASH_LEN];
+  uint8_t want[HASH_LEN];
+  for (size_t i = 0; i < sizeof(in); i++) {
+    in[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  void *memory = nullptr;
+  if (posix_memalign(&memory, ARENA_PAGE, aquahash_batch_memsize(32)) != 0) {
+    return false;
+  }
+  // nonces from the midstate path, crossing a carry into the high half
+  const uint64_t nonce = 0x12345678fffffffcULL;
+  uint8_t nonceIn[n * HASH_INPUT_LEN];
+  for (size_t i = 0; i < n; i++) {
+    uint64_t lane_nonce = nonce + i;
+    memcpy(nonceIn + i * HASH_INPUT_LEN, in, 32);
+    memcpy(nonceIn + i * HASH_INPUT_LEN + 32, &lane_nonce, 8);
+  }
+  uint8_t nonceOut[n * HASH_LEN];
+  bool ok = true;
+  for (int v = 0; v < 3 && ok; v++) {
+    aquahash_batch(out, in, n, mems[v], memory);
+    AquahashMidstate mid;
+    aquahash_midstate(&mid, in, mems[v]);
+    aquahash_batch_nonces(nonceOut, mid, nonce, n, memory);
+    for (size_t i = 0; i < n && ok; i++) {
+      ok = ARGON2_OK ==
+               aquahash_version(want, in + i * HASH_INPUT_LEN, mems[v]) &&
+           memcmp(want, out + i * HASH_LEN, HASH_LEN) == 0 &&
+           ARGON2_OK == aquahash_version(want, nonceIn + i * HASH_INPUT_LEN,
+                                         mems[v]) &&
+           memcmp(want, nonceOut + i * HASH_LEN, HASH_LEN) == 0;
+    }
+  }
+  free(memory);
+  return ok;
+}
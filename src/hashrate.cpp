@@ -0,0 +1,133 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "hashrate.hpp"
+
+#include <math.h>    // for exp
+#include <stdlib.h>  // for posix_memalign, free
+
+#include <new>  // for bad_alloc
+
+namespace {
+
+// fold one sample of `rate` over `dt` seconds into r
+void ewma(HashRates *r, double rate, double dt, bool first) {
+  r->now = rate;
+  if (first) {
+    r->m1 = r->m5 = r->m15 = rate;
+    return;
+  }
+  r->m1 += (1 - exp(-dt / 60)) * (rate - r->m1);
+  r->m5 += (1 - exp(-dt / 300)) * (rate - r->m5);
+  r->m15 += (1 - exp(-dt / 900)) * (rate - r->m15);
+}
+
+}  // namespace
+
+HashrateMeter::Counter *HashrateMeter::newCounters(int n) {
+  static_assert(sizeof(Counter) == HASHRATE_COUNTER_BYTES,
+                "a counter must fill its cache lines exactly");
+  void *p = nullptr;
+  if (posix_memalign(&p, HASHRATE_COUNTER_BYTES, n * sizeof(Counter)) != 0) {
+    throw std::bad_alloc();
+  }
+  Counter *c = static_cast<Counter *>(p);
+  for (int i = 0; i < n; i++) {
+    new (&c[i]) Counter;
+  }
+  return c;
+}
+
+void HashrateMeter::FreeCounters::operator()(Counter *c) const { free(c); }
+
+HashrateMeter::HashrateMeter(uint8_t threads)
+    : numThreads(threads),
+      counters(newCounters(threads + 1)),
+      numSamples(0),
+      lastHashes(threads + 1, 0),
+      rates(threads + 1) {
+  for (int i = 0; i <= threads; i++) {
+    counters[i].hashes.store(0, std::memory_order_relaxed);
+    for (auto &v : counters[i].versionHashes) {
+      v.store(0, std::memory_order_relaxed);
+    }
+    rates[i] = HashRates{0, 0, 0, 0};
+  }
+  for (int v = 0; v < NUM_VERSIONS; v++) {
+    lastVersionHashes[v] = 0;
+    versionRates[v] = 0;
+  }
+}
+
+void HashrateMeter::sample(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mu);
+  std::chrono::duration<double> elapsed = now - lastSample;
+  double dt = elapsed.count();
+  if (numSamples != 0 && dt * 1000 < HASHRATE_SAMPLE_MS) {
+    return;
+  }
+  // the first call only sets where counting starts
+  bool first = numSamples == 1;
+  uint64_t total = 0;
+  uint64_t versionTotal[NUM_VERSIONS] = {0};
+  for (int i = 1; i <= numThreads; i++) {
+    uint64_t h = counters[i].hashes.load(std::memory_order_relaxed);
+    for (int v = 0; v < NUM_VERSIONS; v++) {
+      versionTotal[v] +=
+          counters[i].versionHashes[v].load(std::memory_order_relaxed);
+    }
+    if (numSamples != 0) {
+      ewma(&rates[i], (h - lastHashes[i]) / dt, dt, first);
+    }
+    lastHashes[i] = h;
+    total += h;
+  }
+  if (numSamples != 0) {
+    ewma(&rates[0], (total - lastHashes[0]) / dt, dt, first);
+    for (int v = 0; v < NUM_VERSIONS; v++) {
+      versionRates[v] = (versionTotal[v] - lastVersionHashes[v]) / dt;
+    }
+  }
+  lastHashes[0] = total;
+  for (int v = 0; v < NUM_VERSIONS; v++) {
+    lastVersionHashes[v] = versionTotal[v];
+  }
+  lastSample = now;
+  numSamples++;
+}
+
+uint64_t HashrateMeter::hashes() const {
+  uint64_t total = 0;
+  for (int i = 1; i <= numThreads; i++) {
+    total += counters[i].hashes.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+HashRates HashrateMeter::total() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return rates[0];
+}
+
+HashRates HashrateMeter::thread(uint8_t thread_id) const {
+  std::lock_guard<std::mutex> lock(mu);
+  return rates[thread_id];
+}
+
+double HashrateMeter::version(int v) const {
+  std::lock_guard<std::mutex> lock(mu);
+  return versionRates[v];
+}
@@ -0,0 +1,334 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "hexcodec.hpp"
+
+#include <stdint.h>  // for uint8_t, uint16_t
+#include <string.h>  // for memcpy, strlen
+
+#include <string>  // for string
+
+// Same as the hashing kernels: with gcc on x86 every codec is built in, each
+// in its own `#pragma GCC target` region, and the cpu picks at run time.
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HEX_MULTIARCH
+#endif
+#if defined(HEX_MULTIARCH) || defined(__SSSE3__)
+#define HEX_SSSE3
+#endif
+#if defined(HEX_MULTIARCH) || defined(__AVX2__)
+#define HEX_AVX2
+#endif
+
+#if defined(HEX_SSSE3) || defined(HEX_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const char lowerDigits[] = "0123456789abcdef";
+const char upperDigits[] = "0123456789ABCDEF";
+
+struct Tables {
+  uint16_t pairs[256];  // both digits of a byte, as they go in memory
+  uint8_t values[256];  // what a digit is worth, 0xff if it isn't one
+  Tables() {
+    for (int i = 0; i < 256; i++) {
+      char pair[2] = {lowerDigits[i >> 4], lowerDigits[i & 15]};
+      memcpy(&pairs[i], pair, 2);
+      values[i] = 0xff;
+    }
+    for (int i = 0; i < 16; i++) {
+      values[static_cast<uint8_t>(lowerDigits[i])] = i;
+      values[static_cast<uint8_t>(upperDigits[i])] = i;
+    }
+  }
+};
+
+const Tables &tables() {
+  static const Tables t;
+  return t;
+}
+
+// Every codec encodes `len` bytes into 2 * len digits (no NUL) and decodes
+// 2 * len digits into `len` bytes, false if any of them isn't hex.
+namespace table {
+void encode(char *out, const uint8_t *in, size_t len) {
+  const uint16_t *pairs = tables().pairs;
+  for (size_t i = 0; i < len; i++) {
+    memcpy(out + 2 * i, &pairs[in[i]], 2);
+  }
+}
+bool decode(uint8_t *out, const char *in, size_t len) {
+  const uint8_t *values = tables().values;
+  unsigned bad = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned hi = values[static_cast<uint8_t>(in[2 * i])];
+    unsigned lo = values[static_cast<uint8_t>(in[2 * i + 1])];
+    bad |= hi | lo;
+    out[i] = static_cast<uint8_t>(hi << 4 | lo);
+  }
+  return bad < 16;
+}
+}  // namespace table
+
+#if defined(HEX_SSSE3)
+#if defined(HEX_MULTIARCH)
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+#endif
+
+namespace ssse3 {
+// the high and low digit of each byte of `v`
+inline void digits(__m128i v, __m128i *hi, __m128i *lo) {
+  const __m128i lut =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(lowerDigits));
+  const __m128i low4 = _mm_set1_epi8(0x0f);
+  *hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+  *lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, low4));
+}
+
+// 16 digits into 8 16-bit words of hi * 16 + lo, clearing lanes of `ok`
+// that weren't a digit. '0'-'9' are c - '0' <= 9, and 'a'-'f' or 'A'-'F'
+// are (c | 0x20) - 'a' <= 5, both unsigned.
+inline __m128i pairs(const char *in, __m128i *ok) {
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+  __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+  __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                           _mm_set1_epi8('a'));
+  __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+  *ok = _mm_and_si128(*ok, _mm_or_si128(isDigit, isLetter));
+  __m128i v = _mm_or_si128(
+      _mm_and_si128(isDigit, d),
+      _mm_and_si128(isLetter, _mm_add_epi8(l, _mm_set1_epi8(10))));
+  return _mm_maddubs_epi16(v, _mm_set1_epi16(0x0110));
+}
+
+void encode(char *out, const uint8_t *in, size_t len) {
+  __m128i hi, lo;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    digits(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), &hi,
+           &lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                     _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+                     _mm_unpackhi_epi8(hi, lo));
+  }
+  // a nonce is 8 bytes
+  if (i + 8 <= len) {
+    digits(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i)), &hi,
+           &lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                     _mm_unpacklo_epi8(hi, lo));
+    i += 8;
+  }
+  table::encode(out + 2 * i, in + i, len - i);
+}
+
+bool decode(uint8_t *out, const char *in, size_t len) {
+  __m128i ok = _mm_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = pairs(in + 2 * i, &ok);
+    __m128i b = pairs(in + 2 * i + 16, &ok);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packus_epi16(a, b));
+  }
+  if (i + 8 <= len) {
+    __m128i a = pairs(in + 2 * i, &ok);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packus_epi16(a, a));
+    i += 8;
+  }
+  bool tail = table::decode(out + i, in + 2 * i, len - i);
+  return tail && _mm_movemask_epi8(ok) == 0xffff;
+}
+}  // namespace ssse3
+
+#if defined(HEX_MULTIARCH)
+#pragma GCC pop_options
+#endif
+#endif  // HEX_SSSE3
+
+#if defined(HEX_AVX2)
+#if defined(HEX_MULTIARCH)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2 {
+// ssse3's, both 128-bit lanes at once
+inline void digits(__m256i v, __m256i *hi, __m256i *lo) {
+  const __m256i lut = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(lowerDigits)));
+  const __m256i low4 = _mm256_set1_epi8(0x0f);
+  *hi = _mm256_shuffle_epi8(lut,
+                            _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+  *lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low4));
+}
+
+inline __m256i pairs(const char *in, __m256i *ok) {
+  __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+  __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  __m256i isDigit =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+  __m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+                              _mm256_set1_epi8('a'));
+  __m256i isLetter =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+  *ok = _mm256_and_si256(*ok, _mm256_or_si256(isDigit, isLetter));
+  __m256i v = _mm256_or_si256(
+      _mm256_and_si256(isDigit, d),
+      _mm256_and_si256(isLetter, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+  return _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x0110));
+}
+
+void encode(char *out, const uint8_t *in, size_t len) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i hi, lo;
+    digits(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i)),
+           &hi, &lo);
+    // unpacking stays inside 128-bit lanes: a holds bytes 0-7 and 16-23,
+    // b bytes 8-15 and 24-31
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i),
+                        _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  ssse3::encode(out + 2 * i, in + i, len - i);
+}
+
+bool decode(uint8_t *out, const char *in, size_t len) {
+  __m256i ok = _mm256_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = pairs(in + 2 * i, &ok);
+    __m256i b = pairs(in + 2 * i + 32, &ok);
+    // packing is per lane too, its 64-bit words are bytes 0-7, 16-23,
+    // 8-15 and 24-31
+    __m256i packed = _mm256_packus_epi16(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_permute4x64_epi64(packed,
+                                                 _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  bool tail = ssse3::decode(out + i, in + 2 * i, len - i);
+  return tail && _mm256_movemask_epi8(ok) == -1;
+}
+}  // namespace avx2
+
+#if defined(HEX_MULTIARCH)
+#pragma GCC pop_options
+#endif
+#endif  // HEX_AVX2
+
+bool cpu_generic() { return true; }
+#if defined(HEX_SSSE3)
+bool cpu_ssse3() { return __builtin_cpu_supports("ssse3"); }
+#endif
+#if defined(HEX_AVX2)
+bool cpu_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+struct Codec {
+  const char *name;
+  void (*encode)(char *out, const uint8_t *in, size_t len);
+  bool (*decode)(uint8_t *out, const char *in, size_t len);
+  bool (*supported)();
+};
+
+// dispatch table, widest first
+const Codec codecs[] = {
+#if defined(HEX_AVX2)
+    {"avx2", avx2::encode, avx2::decode, cpu_avx2},
+#endif
+#if defined(HEX_SSSE3)
+    {"ssse3", ssse3::encode, ssse3::decode, cpu_ssse3},
+#endif
+    {"table", table::encode, table::decode, cpu_generic},
+};
+const size_t numCodecs = sizeof(codecs) / sizeof(codecs[0]);
+
+const Codec *pick_codec() {
+  for (size_t i = 0; i + 1 < numCodecs; i++) {
+    if (codecs[i].supported()) {
+      return &codecs[i];
+    }
+  }
+  return &codecs[numCodecs - 1];
+}
+
+// set by hexSelect(), before any hex goes through
+const Codec *forcedCodec = nullptr;
+
+const Codec *codec() {
+  if (forcedCodec != nullptr) {
+    return forcedCodec;
+  }
+  static const Codec *c = pick_codec();
+  return c;
+}
+
+}  // namespace
+
+void hexEncode(char *out, const uint8_t *in, size_t len) {
+  codec()->encode(out, in, len);
+  out[2 * len] = '\0';
+}
+
+bool hexDecode(uint8_t *out, const char *in, size_t digits) {
+  return digits % 2 == 0 && codec()->decode(out, in, digits / 2);
+}
+
+bool hexDecodeString(uint8_t *out, const char *in) {
+  if (in[0] == '0' && in[1] == 'x') {
+    in += 2;
+  }
+  return hexDecode(out, in, strlen(in));
+}
+
+const char *hexIsa() { return codec()->name; }
+
+bool hexSelect(const std::string &name) {
+  if (name == "auto") {
+    forcedCodec = nullptr;
+    return true;
+  }
+  for (size_t i = 0; i < numCodecs; i++) {
+    if (name == codecs[i].name && codecs[i].supported()) {
+      forcedCodec = &codecs[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string hexCodecs() {
+  std::string names;
+  for (size_t i = 0; i < numCodecs; i++) {
+    if (codecs[i].supported()) {
+      names += names.empty() ? "" : " ";
+      names += codecs[i].name;
+    }
+  }
+  return names;
+}
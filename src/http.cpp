@@ -15,29 +15,34 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
-#include <bits/exception.h>       // for exception
-#include <curl/curl.h>            // for curl_easy_setopt
-#include <jsoncpp/json/config.h>  // for JSONCPP_STRING
-#include <jsoncpp/json/reader.h>  // for CharReader, CharRea...
-#include <jsoncpp/json/value.h>   // for Value, arrayValue
-#include <jsoncpp/json/writer.h>  // for operator<<
-#include <spdlog/fmt/fmt.h>       // for format_to
-#include <stdint.h>               // for uint8_t
-#include <string.h>               // for strcmp, strcpy, strlen
-
-#include <atomic>    // for atomic_ullong, __at...
-#include <chrono>    // for duration, high_reso...
-#include <cstdio>    // for printf, sprintf
-#include <iostream>  // for operator<<, endl
-#include <memory>    // for __shared_ptr_access
-#include <mutex>     // for mutex
+#include <bits/exception.h>      // for exception
+#include <curl/curl.h>           // for curl_easy_setopt
+#include <jsoncpp/json/value.h>  // for Value, arrayValue
+#include <spdlog/fmt/fmt.h>      // for format_to
+#include <stdint.h>              // for uint8_t
+#include <string.h>              // for strcmp, strcpy, strlen
+
+#include <algorithm>  // for max
+#include <atomic>     // for atomic_ullong, __at...
+#include <chrono>     // for duration, high_reso...
+#include <cstdio>     // for printf, sprintf
+#include <iostream>   // for operator<<, endl
+#include <memory>     // for __shared_ptr_access
+#include <random>     // for random_device
 #include <stdexcept>
 #include <string>   // for string, operator<<
 #include <thread>   // for sleep_for
 #include <utility>  // for move
 
-#include "aqua.hpp"                               // for decodeHex, computeD...
+#include "aqua.hpp"                               // for hex0x2bin
+#include "engine.hpp"                             // for aquahash_batch_isa
+#include "hexcodec.hpp"                           // for hexEncode
+#include "jsonscan.hpp"                           // for scanGetwork
 #include "miner.hpp"                              // for Miner, WorkPacket
+#include "nonce.hpp"                              // for NonceAllocator
+#include "pool.hpp"                               // for Pool, resolveUrl
+#include "stratum.hpp"                            // for StratumClient
+#include "work.hpp"                               // for Work
 #include "spdlog/details/log_msg-inl.h"           // for log_msg::log_msg
 #include "spdlog/logger.h"                        // for logger
 #include "spdlog/sinks/ansicolor_sink-inl.h"      // for ansicolor_sink::pri...
@@ -55,6 +60,19 @@
 #define GETWORK 1
 #define SUBMITWORK 2
 
+// hashrate log period
+#define REPORT_MS (3000)
+// how often the pool choice is looked at again, and how long to wait for
+// a pool to take a connection before calling it down
+#define POOL_TICK_MS (250)
+#define CONNECT_TIMEOUT_MS (2000)
+// biggest getwork or submit reply read, they are a few hundred bytes
+#define RECV_MAX (4096)
+
+// stratum+tcp: how long to wait for a share's answer, and to reconnect
+#define STRATUM_SUBMIT_MS (5000)
+#define STRATUM_AGENT "aquaminer"
+
 using std::atomic_ullong;
 using std::cout;
 using std::endl;
@@ -63,32 +81,89 @@ using std::string;
 atomic_ullong sharesSubmitted;
 atomic_ullong sharesValid;
 atomic_ullong errCount;
-
-Miner::Miner(const std::string url, const uint8_t nThreads, const uint8_t nCPU,
-             const bool verboseLogs, const bool bench, const bool solo) {
-  poolUrl = url;
+atomic_ullong sharesStale;    // dropped, mining had moved on
+atomic_ullong sharesDropped;  // dropped, the pool never answered
+
+Miner::Miner(const std::vector<PoolSpec> &poolSpecs, const bool split,
+             const uint8_t nThreads, const uint8_t nCPU,
+             const bool verboseLogs, const bool bench, const bool solo,
+             const int noncePrefix, const std::vector<int> &pin,
+             const int batch, const std::string &metricsAddr,
+             const unsigned long long shareDiff) {
+  activePool = -1;
+  splitPools = split;
   numThreads = nThreads;
   num_cpus = nCPU;
   verbose = verboseLogs;
   benching = bench;
   solomining = solo;
-  this->currentWork = new WorkPacket();
+  useEngine = false;
+  hashLanes = 1;
+  batchWidths = batch;
+  pinCpus = pin;
+  metricsListen = metricsAddr;
+  foundShares = 0;
+  foundBlocks = 0;
+  targets.setMinShareDifficulty(shareDiff);
+  startedAt = std::chrono::steady_clock::now();
+  // rigs without a prefix pick one at random, so two of them on one pool
+  // account overlap only if they happen to pick the same one
+  rigPrefix = static_cast<uint16_t>(noncePrefix);
+  if (noncePrefix < 0) {
+    rigPrefix = static_cast<uint16_t>(std::random_device{}());
+  }
+  nonces = nullptr;       // once the thread count is known, see start()
+  switchClock = nullptr;  // same
+  meter = nullptr;        // same
+  // request headers for every curl handle, see initcurl()
+  headers = curl_slist_append(nullptr, "User-Agent: AquaMinerPro/" VERSION);
+  headers = curl_slist_append(headers, "Content-Type: application/json");
   this->logger = spdlog::stderr_color_mt("MINER");
   this->getworklog = spdlog::stderr_color_mt("GETWORK");
 
-  this->getworkcurl = curl_easy_init();
-  this->initcurl(this->getworkcurl, GETWORK);
-  // this->submitcurl = curl_easy_init();
-  // this->initcurl(this->submitcurl, SUBMITWORK);
+  // stratum+tcp:// pools get jobs and shares over one tcp connection, the
+  // Pool sets that up. Others get a getwork handle and one submit handle
+  // for every share, so the connection stays open between them.
+  for (const PoolSpec &spec : poolSpecs) {
+    Pool *pool = new Pool(spec, static_cast<int>(pools.size()));
+    pool->getworkcurl = curl_easy_init();
+    this->initcurl(pool->getworkcurl, GETWORK, spec.url);
+    pool->submitcurl = curl_easy_init();
+    this->initcurl(pool->submitcurl, SUBMITWORK, spec.url);
+    pools.push_back(pool);
+  }
+}
+
+// a reply read into fixed storage, for the scanners in jsonscan.hpp
+struct RecvBuf {
+  char data[RECV_MAX];
+  std::size_t len;
+};
+
+static std::size_t recvCallback(const char *in, std::size_t size,
+                                std::size_t num, RecvBuf *out) {
+  const std::size_t totalBytes(size * num);
+  if (totalBytes > sizeof(out->data) - out->len) {
+    return 0;  // too big to be a reply we want, curl gives up on it
+  }
+  memcpy(out->data + out->len, in, totalBytes);
+  out->len += totalBytes;
+  return totalBytes;
 }
 
 Miner::~Miner() {
   printf("Miner dead!\n");
-  curl_easy_cleanup(this->getworkcurl);
-  // curl_easy_cleanup(this->submitcurl);
+  delete nonces;
+  delete switchClock;
+  delete meter;
+  for (Pool *pool : pools) {
+    delete pool;
+  }
+  curl_slist_free_all(headers);
 }
 
 int aquahash_version(void *out, const void *in, uint32_t mem);
+double aquahash_rate(uint32_t mem, unsigned long long n, bool useArena);
 
 void Miner::getworkThread(const char *thread_id) {
   auto logger = spdlog::stdout_color_mt("HTTP");
@@ -117,14 +192,10 @@ void Miner::getworkThread(const char *thread_id) {
                sch.sched_priority, policy);
 #endif
 
-  this->numTries = 0;
   typedef std::chrono::high_resolution_clock Time;
   auto t1 = Time::now();
   auto ltime = Time::now();
-  unsigned long long totalHash = 0;
-  unsigned long long numHashesSinceLast = 0;
-  float fps = 0.0;
-  char fpsbuf[100];
+  uint64_t totalHash = 0;
 
   // bench mark and exit
   if (benching) {
@@ -134,104 +205,277 @@ void Miner::getworkThread(const char *thread_id) {
     if (std::getenv("TRAVIS_COMPILER") != nullptr) {
       numHashesTotal = 1000;
     }
-    workmu.lock();
     uint8_t in[40];
     uint8_t out[32];
-    this->currentWork->version = '2';
     aquahash_version(out, in, 1);
     printf("Aquahash v2 Benchmark zero[32]=");
     print_hex(out, 32);
 
+    // one thread, per-hash malloc (old) vs per-thread arena (miner threads)
+    unsigned long long numHashesAlloc =
+        std::max(numHashesTotal / 100, 1000ULL);
+    double heapRate = aquahash_rate(1, numHashesAlloc, false);
+    double arenaRate = aquahash_rate(1, numHashesAlloc, true);
+    printf(
+        "allocator benchmark %llu hashes: heap %4.4f kHs/sec, "
+        "arena %4.4f kHs/sec (%+.1f%%)\n",
+        numHashesAlloc, heapRate / 1000, arenaRate / 1000,
+        heapRate > 0 ? (arenaRate / heapRate - 1) * 100 : 0.0);
+
     logger->info("Starting {} hashes", numHashesTotal);
+    std::shared_ptr<Work> benchWork(new Work);
+    benchWork->version = '2';
     for (int i = 0; i < 31; i = i + 2) {
-      this->currentWork->inputStr[i] = '1';
-      this->currentWork->inputStr[i + 2] = '1';
+      benchWork->inputStr[i] = '1';
+      benchWork->inputStr[i + 2] = '1';
     }
-    workmu.unlock();
+    publishWork(benchWork);
     // t1
     t1 = std::chrono::high_resolution_clock::now();
+    uint64_t startHash = meter->hashes();
     // wait for hashes
     while (totalHash < numHashesTotal) {
-      totalHash += this->numTries;
       std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      totalHash = meter->hashes() - startHash;
     }
 
     // t2
     std::chrono::duration<double> dur =
         std::chrono::high_resolution_clock::now() - t1;
 
-    workmu.lock();
-    this->currentWork->inputStr[0] = '!';  // triggers a work copy
-    this->currentWork->version = '!';      // kills the miners (if benching)
-    workmu.unlock();
+    std::shared_ptr<Work> stopWork(new Work);
+    stopWork->inputStr[0] = '!';
+    stopWork->version = '!';  // kills the miners (if benching)
+    publishWork(stopWork);
 
     // print hashrate and duration
     double sec = dur.count();
     printf("benchmark completed %llu hashes in %4.4f seconds (%4.4f kHs/sec)\n",
-           totalHash, sec, totalHash / sec / 1000);
+           static_cast<unsigned long long>(totalHash), sec,
+           totalHash / sec / 1000);
     return;
   }
-  logger->info("getwork loop starting");
+  // every pool gets its own thread, a slow one can't hold up the others
+  logger->info("getwork loop starting, {} pool{}", pools.size(),
+               pools.size() == 1 ? "" : "s");
+  for (Pool *pool : pools) {
+    std::thread(&Miner::poolThread, this, pool).detach();
+  }
+  auto nextReport = Time::now() + std::chrono::milliseconds(REPORT_MS);
   while (true) {
-    if (!this->getwork()) {
-      logger->warn("getwork() failed");
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-      continue;
-    };
-    // print hashrate
-    t1 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> durationSinceLast = t1 - ltime;
-    ltime = t1;
-
-    numHashesSinceLast = this->numTries;
-    this->numTries = 0;
-    if (numHashesSinceLast == 0 && totalHash != 0) {
-      logger->warn("miner threads have been sleeping?");
-      std::this_thread::sleep_for(std::chrono::milliseconds(3000));
-      continue;
+    // health moves on its own, and with --pool-split turns run out
+    selectPool(splitPools && std::chrono::steady_clock::now() >= sliceEnd);
+    meter->sample();
+    if (Time::now() >= nextReport) {
+      t1 = Time::now();
+      std::chrono::duration<double> durationSinceLast = t1 - ltime;
+      ltime = t1;
+      reportHashrate(durationSinceLast.count(), &totalHash);
+      nextReport = t1 + std::chrono::milliseconds(REPORT_MS);
     }
+    std::this_thread::sleep_for(std::chrono::milliseconds(POOL_TICK_MS));
+  }
+}
 
-    // calculate hashrate
-    totalHash += numHashesSinceLast;
-    fps = static_cast<double>(numHashesSinceLast) / durationSinceLast.count();
-    if (fps == 0) {
-      if (totalHash != 0) {
-        logger->warn("can't calculate hashrate?");
+// poolThread keeps `pool`'s job fresh: listening on its stratum connection,
+// or polling it. A pool that stops answering is dropped right away, the
+// next one in line takes over within a tick.
+void Miner::poolThread(Pool *pool) {
+  const std::string &url = pool->spec.url;
+  logger->info("pool {}: {} loop starting for {}", pool->index + 1,
+               pool->stratum != nullptr ? "stratum" : "getwork", url);
+  std::string longPollUrl;
+  while (true) {
+    if (pool->stratum != nullptr) {
+      // the pool pushes jobs, listen for them a report's worth at a time
+      stratumWork(pool, REPORT_MS);
+      if (!pool->stratum->connected()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
       }
-      std::this_thread::sleep_for(std::chrono::milliseconds(3000));
       continue;
     }
-    unsigned long long submitted = sharesSubmitted;
-    unsigned long long submittedValid = sharesValid;
-    unsigned long long errs = errCount;
-    unsigned long long rejected = submitted - submittedValid;
-    sprintf(fpsbuf, "Aquahash v%c [%04.4f kH/s] (%010llu) Valid=%llu Bad=%llu",
-            this->currentWork->version, fps / 1000.00, totalHash,
-            submittedValid, rejected);
-    this->logger->info("{}", fpsbuf);
-
-    if (errs != 0) {
-      logger->warn("Pool HTTP Errors = %lu\n", errs);
+    pool->poll([&] {
+      if (!this->getwork(pool, pool->getworkcurl, &longPollUrl)) {
+        logger->warn("pool {}: getwork() failed", pool->index + 1);
+        selectPool(false);
+        return false;
+      }
+      // the pool offers long polling, let a second connection wait on it
+      if (!longPollUrl.empty() && !pool->longPolling.exchange(true)) {
+        std::thread(&Miner::longPollThread, this, pool, longPollUrl).detach();
+      }
+      return true;
+    });
+  }
+}
+
+// stratumWork (re)connects to a stratum pool and publishes the jobs it
+// pushes for up to `ms`
+void Miner::stratumWork(Pool *pool, long ms) {
+  StratumClient *stratum = pool->stratum;
+  const std::string &url = pool->spec.url;
+  if (!stratum->connected()) {
+    if (!stratum->connect(url, STRATUM_AGENT)) {
+      getworklog->warn("can't connect to {}", url);
+      pool->failed();
+      selectPool(false);
+      return;  // try again in a second
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+    logger->info("connected to stratum pool {}", url);
+  }
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  Json::Value job;
+  while (ms > 0 && stratum->nextJob(&job, static_cast<int>(ms))) {
+    pool->answered(-1);
+    setWork(pool, job);
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+             until - std::chrono::steady_clock::now())
+             .count();
+  }
+  if (!stratum->connected()) {
+    getworklog->warn("lost connection to {}", url);
+    pool->failed();
+    selectPool(false);
   }
 }
-namespace {
-std::size_t callback(const char *in, std::size_t size, std::size_t num,
-                     std::string *out) {
-  const std::size_t totalBytes(size * num);
-  out->append(in, totalBytes);
-  return totalBytes;
+
+// longPollThread keeps one request open at the pool's long poll url. The
+// pool answers it when there is new work, then it goes right back.
+void Miner::longPollThread(Pool *pool, std::string url) {
+  logger->info("pool {} supports long polling: {}", pool->index + 1, url);
+  CURL *curl = curl_easy_init();
+  this->initcurl(curl, GETWORK, url);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, LONGPOLL_TIMEOUT);
+  pool->longPoll([&] { return this->getwork(pool, curl, nullptr); },
+                 LONGPOLL_BACKOFF_MS);
+  curl_easy_cleanup(curl);
+  logger->warn("long polling failed {} times, polling instead",
+               LONGPOLL_FAILURES);
 }
-}  // namespace
 
-// initcurl sets the curl handle for the getwork() calls
-void Miner::initcurl(CURL *curl, int typ) {
-  // headers
+void Miner::reportHashrate(double seconds, uint64_t *lastHashes) {
+  uint64_t hashes = meter->hashes();
+  uint64_t numHashesSinceLast = hashes - *lastHashes;
+  if (numHashesSinceLast == 0 && *lastHashes != 0) {
+    logger->warn("miner threads have been sleeping?");
+    return;
+  }
 
-  struct curl_slist *headers = nullptr;
-  headers = curl_slist_append(headers, "User-Agent: AquaMinerPro/" VERSION);
-  headers = curl_slist_append(headers, "Content-Type: application/json");
+  // calculate hashrate
+  *lastHashes = hashes;
+  double fps = static_cast<double>(numHashesSinceLast) / seconds;
+  if (fps == 0) {
+    if (hashes != 0) {
+      logger->warn("can't calculate hashrate?");
+    }
+    return;
+  }
+  HashRates rates = meter->total();
+  std::shared_ptr<const Work> work = workChannel.read();
+  char version = work != nullptr ? work->version : '?';
+  unsigned long long submitted = sharesSubmitted;
+  unsigned long long submittedValid = sharesValid;
+  unsigned long long errs = errCount;
+  unsigned long long rejected = submitted - submittedValid;
+  unsigned long long blocks = foundBlocks;
+  // how long the last new work took to reach every miner thread
+  char switchbuf[32] = "n/a";
+  long long switchUsec = switchClock->latency();
+  if (switchUsec >= 0) {
+    snprintf(switchbuf, sizeof(switchbuf), "%.1fms", switchUsec / 1000.0);
+  }
+  // where new work comes from
+  int active = activePool;
+  const Pool *pool = pools[active < 0 ? 0 : active];
+  std::string source =
+      pool->stratum != nullptr
+          ? std::string(pool->stratum->connected() ? "stratum"
+                                                   : "stratum/down")
+      : pool->longPolling ? std::string("longpoll")
+                          : fmt::format("poll/{}ms", pool->pollInterval());
+  if (pools.size() > 1) {
+    source = fmt::format("#{}/{}", pool->index + 1, source);
+  }
+  char fpsbuf[200];
+  snprintf(fpsbuf, sizeof(fpsbuf),
+           "Aquahash v%c [%04.4f kH/s] (%010llu) 1/5/15m=%.1f/%.1f/%.1f "
+           "Valid=%llu Bad=%llu Blocks=%llu Switch=%s Work=%s",
+           version, fps / 1000.00,
+           static_cast<unsigned long long>(hashes), rates.m1 / 1000.00,
+           rates.m5 / 1000.00, rates.m15 / 1000.00, submittedValid, rejected,
+           blocks, switchbuf, source.c_str());
+  this->logger->info("{}", fpsbuf);
+
+  // how each pool is doing, when there is more than one
+  if (pools.size() > 1) {
+    for (const Pool *p : pools) {
+      logger->info("pool {}{} {} {} {:.0f}ms err={:.0f}% Valid={} Bad={}",
+                   p->index + 1, p->index == active ? "*" : " ",
+                   p->up() ? "up  " : "down", p->spec.url, p->latency(),
+                   p->errorRate() * 100, p->accepted.load(),
+                   p->rejected.load());
+    }
+  }
+
+  if (errs != 0) {
+    logger->warn("Pool HTTP Errors = {}", errs);
+  }
+}
+
+// metrics is what the metrics endpoint shows, on its thread
+MetricsSnapshot Miner::metrics() {
+  MetricsSnapshot m;
+  m.version = VERSION;
+  m.kernel = useEngine ? aquahash_batch_isa() : "libaquahash";
+  std::chrono::duration<double> uptime =
+      std::chrono::steady_clock::now() - startedAt;
+  m.uptime = uptime.count();
+  m.hashrate = HashRates();
+  m.hashes = 0;
+  if (meter != nullptr) {  // not started yet
+    m.hashrate = meter->total();
+    m.hashes = meter->hashes();
+    for (int i = 1; i <= meter->threads(); i++) {
+      m.threadHashrate.push_back(meter->thread(i));
+    }
+    for (int i = 0; i < NUM_VERSIONS; i++) {
+      m.versionHashrate.push_back(std::make_pair(static_cast<char>('2' + i),
+                                                 meter->version(i)));
+    }
+  }
+  m.foundShares = foundShares;
+  m.foundBlocks = foundBlocks;
+  unsigned long long valid = sharesValid;
+  m.accepted = valid;
+  m.rejected = sharesSubmitted - valid;
+  m.stale = sharesStale;
+  m.dropped = sharesDropped;
+  m.errors = errCount;
+  int active;
+  {
+    std::lock_guard<std::mutex> lock(publishmu);
+    active = activePool;
+  }
+  for (const Pool *pool : pools) {
+    MetricsSnapshot::Pool p;
+    p.url = pool->spec.url;
+    p.active = pool->index == active;
+    p.up = pool->up();
+    p.latency = pool->latency();
+    p.errorRate = pool->errorRate();
+    p.accepted = pool->accepted;
+    p.rejected = pool->rejected;
+    m.pools.push_back(p);
+  }
+  m.getwork = getworkLatency.snapshot();
+  m.submit = submitLatency.snapshot();
+  m.workSwitch = switchLatency.snapshot();
+  return m;
+}
+
+// initcurl sets the curl handle for the getwork() calls to `url`
+void Miner::initcurl(CURL *curl, int typ, const std::string &url) {
+  // headers, built once by the constructor as long poll handles come and go
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   if (typ == GETWORK) {
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS,
@@ -248,42 +492,58 @@ void Miner::initcurl(CURL *curl, int typ) {
   curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
 
   // Set remote URL.
-  curl_easy_setopt(curl, CURLOPT_URL, poolUrl.c_str());
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 
   // Don't bother trying IPv6, which would increase DNS resolution time.
   curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
 
   // Don't wait forever, time out after 10 seconds.
   curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
+  // A pool that doesn't even take the connection is down, fail over.
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, CONNECT_TIMEOUT_MS);
 
   // Follow HTTP redirects if necessary.
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
+  // Keep the connection open between requests.
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
   // Hook up data handling function.
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, recvCallback);
 }
 
-bool Miner::getwork() {
+// getwork on `curl` (pool->getworkcurl, or a long poll handle). `longPoll`
+// gets the long poll url the pool advertised, empty if none. Polls, not long
+// polls, time the pool and mark it down when they fail.
+bool Miner::getwork(Pool *pool, CURL *curl, std::string *longPoll) {
+  const std::string &poolUrl = pool->spec.url;
   // Hook up data container (will be passed as the last parameter to the
   // callback handling function).  Can be any pointer type, since it will
   // internally be passed as a void pointer.
-  std::unique_ptr<std::string> httpData(new std::string());
-  curl_easy_setopt(getworkcurl, CURLOPT_WRITEDATA, httpData.get());
+  RecvBuf httpData;
+  httpData.len = 0;
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &httpData);
   char errbuf[CURL_ERROR_SIZE];
-  curl_easy_setopt(getworkcurl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
   errbuf[0] = 0;  // empty string
+  std::string advertised;
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, longPollHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &advertised);
 
   // Response information.
   CURLcode res;
   long httpCode(0);
 
   // Run our HTTP POST command, capture the HTTP response code
-  res = curl_easy_perform(getworkcurl);
-  curl_easy_getinfo(getworkcurl, CURLINFO_RESPONSE_CODE, &httpCode);
+  auto sent = std::chrono::steady_clock::now();
+  res = curl_easy_perform(curl);
+  std::chrono::duration<double, std::milli> rtt =
+      std::chrono::steady_clock::now() - sent;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+  if (longPoll != nullptr) {
+    *longPoll = advertised.empty() ? "" : resolveUrl(poolUrl, advertised);
+  }
 
-  // parse JSON response
-  string rawJson = *httpData.get();
-  int rawJsonLength = rawJson.length();
   if (res != CURLE_OK || httpCode != 200) {
     size_t len = strlen(errbuf);
     if (len) {
@@ -291,61 +551,145 @@ bool Miner::getwork() {
     } else {
       getworklog->warn("{}", curl_easy_strerror(res));
     }
-    if (rawJsonLength != 0) {
-      std::cout << "HTTP data was:\n" << rawJson << std::endl;
+    if (httpData.len != 0) {
+      std::cout << "HTTP data was:\n";
+      std::cout.write(httpData.data, httpData.len) << std::endl;
+    }
+    if (longPoll != nullptr) {
+      pool->failed();
     }
     return false;
   }
 
-  // Response looks good - done using Curl now.  Try to parse the results
-  // and print them out.
-  Json::Value jsonData;
-  Json::CharReaderBuilder builder;
-  JSONCPP_STRING err;
-  const std::unique_ptr<Json::CharReader> jsonReader(builder.newCharReader());
-  if (!jsonReader->parse(rawJson.c_str(), rawJson.c_str() + rawJsonLength,
-                         &jsonData, &err)) {
-    std::cout << "error" << std::endl;
+  // Response looks good - done using Curl now. Scan the job straight out
+  // of the receive buffer, no allocation per poll.
+  GetworkJob job;
+  if (!scanGetwork(httpData.data, httpData.len, &job)) {
+    getworklog->warn("invalid response from {}: {}", poolUrl,
+                     fmt::string_view(httpData.data, httpData.len));
+    if (longPoll != nullptr) {
+      pool->failed();
+    }
     return false;
   }
-  Json::Value val = jsonData["result"];
-  if (val.type() != Json::arrayValue) {
-    std::cout << "\nGot successful response from " << poolUrl << std::endl;
-    cout << "invalid response: " << jsonData << endl;
-    return false;
+  pool->answered(longPoll != nullptr ? rtt.count() : -1);
+  if (longPoll != nullptr) {
+    getworkLatency.observe(rtt.count());
   }
-
   if (verbose) {
     logger->debug("Got successful response from {}", poolUrl);
-    logger->debug("Successfully parsed JSON data:");
-    std::cout << jsonData.toStyledString() << std::endl;
+    logger->debug("{}", fmt::string_view(httpData.data, httpData.len));
+  }
+  return setWork(pool, job);
+}
+
+// setWork takes a job, [input, seed hash, target, difficulty] as stratum
+// sends it
+bool Miner::setWork(Pool *pool, const Json::Value &val) {
+  GetworkJob job;
+  if (!jobFromJson(val, &job)) {
+    logger->warn("invalid work from pool: {}", val.toStyledString());
+    return false;
   }
-  this->workmu.lock();
-  // got work, copy to currentWork
-  if (0 == strcmp(currentWork->inputStr, val[0].asString().c_str())) {
+  return setWork(pool, job);
+}
+
+// and keeps it as the pool's latest. It is published if the pool is the
+// one being mined and the job is new or the pool changed its share target
+// (vardiff), otherwise the pool may be worth switching to now that it has
+// work.
+bool Miner::setWork(Pool *pool, const GetworkJob &job) {
+  std::lock_guard<std::mutex> lock(publishmu);
+  bool retarget = false;
+  if (!pool->hasJob || 0 != strcmp(pool->job.input, job.input)) {
+    pool->newJob();
+  } else if (0 != strcmp(pool->job.target, job.target)) {
+    retarget = true;
+  }
+  pool->job = job;
+  pool->hasJob = true;
+  if (pool->index != activePool) {
+    switchPool(false);
+    return true;
+  }
+  if (!retarget && currentWork != nullptr &&
+      0 == strcmp(currentWork->inputStr, job.input)) {
     logger->debug("no new work {}", currentWork->inputStr);
-    this->workmu.unlock();
     return true;
   }
+  loadWork(pool);
+  if (retarget) {
+    logger->info("pool {} share difficulty now {}", pool->index + 1,
+                 currentWork->difficulty);
+  }
+  return true;
+}
 
-  // do it
+// selectPool switches to the pool choosePool() picks, if that is another
+// one. `rotate` ends the active pool's --pool-split turn.
+void Miner::selectPool(bool rotate) {
+  std::lock_guard<std::mutex> lock(publishmu);
+  switchPool(rotate);
+}
 
-  // save input
+void Miner::switchPool(bool rotate) {
+  std::vector<PoolChoice> choices;
+  for (const Pool *pool : pools) {
+    PoolChoice c = {pool->spec.priority, pool->hasJob && pool->up(),
+                    pool->score()};
+    choices.push_back(c);
+  }
+  int next = choosePool(choices, activePool, splitPools, rotate);
+  if (next < 0) {
+    return;  // nothing better than the work we have
+  }
+  Pool *pool = pools[next];
+  if (next != activePool || rotate) {
+    sliceEnd = std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(POOL_SLICE_MS * pool->spec.weight);
+  }
+  if (next == activePool) {
+    return;
+  }
+  if (activePool >= 0 && !rotate) {
+    logger->warn("switching from pool {} to pool {} ({})", activePool + 1,
+                 next + 1, pool->spec.url);
+  } else {
+    logger->info("mining on pool {} ({})", next + 1, pool->spec.url);
+  }
+  activePool = next;
+  loadWork(pool);
+}
 
-  strcpy(currentWork->inputStr, val[0].asString().c_str());
-  // get version
-  currentWork->version = val[1].asString().c_str()[65];
-  // get input byte
-  hex0x2bin(val[0].asString().c_str(), currentWork->input);
-  // decode hex difficulty
-  decodeHex(val[3].asString().c_str(), currentWork->difficulty);
+// loadWork makes `pool`'s job the current work and publishes it, holding
+// publishmu. Everything the miner threads need is worked out here, once.
+void Miner::loadWork(const Pool *pool) {
+  const GetworkJob &job = pool->job;
+  std::shared_ptr<Work> work(new Work);
+  work->pool = pool->index;
+  strcpy(work->inputStr, job.input);
+  work->version = job.version;
+  if (!hex0x2bin(job.input, work->input)) {
+    logger->error("pool {} sent a header that isn't hex: {}",
+                  pool->index + 1, job.input);
+    return;
+  }
 
-  // compute target
-  decodeHex(val[2].asString().c_str(), currentWork->target);
-  // compute difficulty
-  computeDifficulty(currentWork->target, currentWork->difficulty);
-  this->workmu.unlock();
-  return true;
+  // the target is the pool's share target, the difficulty the network's
+  targets.compute(job.target, job.difficulty, work->target, work->targetWords,
+                  work->blockWords, &work->difficulty);
+  publishWork(work);
+}
+
+// hand `work` to the miner threads, they share it from now on. Callers
+// other than the bench hold publishmu, every pool thread and long poll
+// thread gets here.
+void Miner::publishWork(const std::shared_ptr<Work> &work) {
+  switchClock->published(workChannel.epoch() + 1);
+  workChannel.publish(work);
+  currentWork = work;
+  logger->info("new work: algo '{}' diff: {} input: {}", work->version,
+               work->difficulty, std::string(work->inputStr).substr(0, 8));
 }
 /*
 static const char *submitfmt =
@@ -357,22 +701,19 @@ static const char *submitfmt =
     */
 
 auto noncelog = spdlog::stdout_color_mt("SUBMIT");
-bool submitwork(WorkPacket *work, string endpoint, const bool verbose,
-                CURL *submitcurl) {
+
+// big endian hex of a nonce, as the pool wants it
+static void nonceToHex(uint64_t nonce, char noncehex[17]) {
+  uint64_t be = __builtin_bswap64(nonce);
 #ifdef DEBUG
-  print_hex(&work->buf[32], 8);
+  print_hex(reinterpret_cast<uint8_t *>(&nonce), 8);
 #endif
-  // flip endianness
-  uint8_t noncebuf[8];
-  int j = 0;
-  for (int i = 7; i >= 0; i--) {
-    noncebuf[i] = work->buf[32 + j];
-    j++;
-  }
+  hexEncode(noncehex, reinterpret_cast<uint8_t *>(&be), 8);
+}
 
-  // to hex
+SubmitResult submitwork(const Share *share, CURL *submitcurl) {
   char noncehex[17];  // plus one for the zero
-  to_hex(noncebuf, noncehex, 8);
+  nonceToHex(share->nonce, noncehex);
 
   // curl request
   char buf[233];  // pool max is 256, but its always the same size (?)
@@ -384,70 +725,161 @@ bool submitwork(WorkPacket *work, string endpoint, const bool verbose,
       "\"0x0000000000000000000000000000000000000000000000000000000000000000\""
       "]"
       "}",
-      noncehex, work->inputStr);
+      noncehex, share->inputStr);
   curl_easy_setopt(submitcurl, CURLOPT_POSTFIELDS, buf);
 
   // Response information.
   long httpCode(0);
-  std::unique_ptr<std::string> httpData(new std::string());
+  RecvBuf httpData;
+  httpData.len = 0;
 
   // Hook up data handling function.
-  curl_easy_setopt(submitcurl, CURLOPT_WRITEFUNCTION, callback);
+  curl_easy_setopt(submitcurl, CURLOPT_WRITEFUNCTION, recvCallback);
 
   // Hook up data container (will be passed as the last parameter to the
   // callback handling function).  Can be any pointer type, since it will
   // internally be passed as a void pointer.
-  curl_easy_setopt(submitcurl, CURLOPT_WRITEDATA, httpData.get());
+  curl_easy_setopt(submitcurl, CURLOPT_WRITEDATA, &httpData);
 
   // Run our HTTP GET command, capture the HTTP response code, and clean up.
   CURLcode res = curl_easy_perform(submitcurl);
   if (res != CURLE_OK) {
     noncelog->error("Pool connection failed");
-    return false;
+    return SUBMIT_FAILED;
   }
 
   curl_easy_getinfo(submitcurl, CURLINFO_RESPONSE_CODE, &httpCode);
 
   //
-  string rawJson = *httpData.get();
-  int rawJsonLength = rawJson.length();
   if (httpCode != 200) {
     noncelog->error("Pool returned ({} bytes) bad status code: {}",
-                    rawJsonLength, httpCode);
-    if (rawJsonLength != 0) {
-      std::cout << "HTTP data was:\n" << rawJson << std::endl;
+                    httpData.len, httpCode);
+    if (httpData.len != 0) {
+      std::cout << "HTTP data was:\n";
+      std::cout.write(httpData.data, httpData.len) << std::endl;
     }
-    return false;
-  }
-
-  Json::Value jsonData;
-  Json::CharReaderBuilder builder;
-  JSONCPP_STRING err;
-  const std::unique_ptr<Json::CharReader> jsonReader(builder.newCharReader());
-  if (!jsonReader->parse(rawJson.c_str(), rawJson.c_str() + rawJsonLength,
-                         &jsonData, &err)) {
-    noncelog->error("error parsing response: {}", err);
-    return false;
+    return SUBMIT_FAILED;
   }
 #ifdef DEBUG
-  noncelog->debug("Successfully parsed JSON data:");
-  std::cout << jsonData.toStyledString() << std::endl;
+  noncelog->debug("{}", fmt::string_view(httpData.data, httpData.len));
 #endif
 
-  Json::Value val = jsonData["result"];
+  bool accepted;
   sharesSubmitted++;
-  if (val.type() != Json::booleanValue) {
+  if (!scanSubmit(httpData.data, httpData.len, &accepted)) {
     noncelog->error(
         "invalid pool response, wasn't true OR false! Maybe switch pools or "
         "check internet connection?");
     errCount++;
-    return false;
+    return SUBMIT_FAILED;
   }
-  if (val.asBool()) {
+  if (accepted) {
     noncelog->info("Pool confirmed a share!");
     sharesValid++;
-  } else {
-    noncelog->warn("Pool marked a share invalid :*(");
+    return SUBMIT_ACCEPTED;
+  }
+  noncelog->warn("Pool marked a share invalid :*(");
+  return SUBMIT_REJECTED;
+}
+
+// same, over the pool's stratum connection
+SubmitResult submitwork(const Share *share, StratumClient *stratum) {
+  char noncehex[17];
+  nonceToHex(share->nonce, noncehex);
+  if (!stratum->connected()) {
+    noncelog->error("Pool connection failed");
+    return SUBMIT_FAILED;
+  }
+  SubmitResult res =
+      stratum->submit(noncehex, share->inputStr, STRATUM_SUBMIT_MS);
+  switch (res) {
+    case SUBMIT_ACCEPTED:
+      sharesSubmitted++;
+      noncelog->info("Pool confirmed a share!");
+      sharesValid++;
+      break;
+    case SUBMIT_REJECTED:
+      sharesSubmitted++;
+      noncelog->warn("Pool marked a share invalid :*(");
+      break;
+    case SUBMIT_FAILED:
+      noncelog->error("Pool didn't answer a share in {}ms", STRATUM_SUBMIT_MS);
+      break;
+  }
+  return res;
+}
+
+// submitThread sends the shares the miner threads queue up, so they never
+// wait on the pool. Shares that get no answer are tried again with backoff
+// while their work is still current. A share goes to the pool its work
+// came from, whichever one is being mined by now. Solo, the first accepted
+// share on a job is the block, the rest are dropped.
+void Miner::submitThread() {
+  uint64_t blockEpoch = 0;  // --solo: work a block was mined on
+  while (true) {
+    Share *share = submitQueue.wait(1000);
+    if (share == nullptr) {
+      if (submitQueue.closed()) {
+        break;
+      }
+      continue;
+    }
+    std::chrono::duration<double, std::milli> queued =
+        std::chrono::steady_clock::now() - share->foundAt;
+    logger->debug("share from thread {} waited {:.1f}ms to be sent",
+                  share->thread_id, queued.count());
+    Pool *pool = pools[share->pool];
+    if (solomining && share->epoch == blockEpoch) {
+      logger->debug("dropping share from thread {}, block already mined",
+                    share->thread_id);
+      sharesStale++;
+      delete share;
+      continue;
+    }
+    if (!pool->up() && share->epoch != workChannel.epoch()) {
+      // mining moved on from a pool that is down, its work is stale
+      logger->debug("dropping share from thread {} for down pool {}",
+                    share->thread_id, pool->index + 1);
+      sharesStale++;
+      delete share;
+      continue;
+    }
+    int backoff = 250;  // ms, doubles every try
+    for (int tries = 1;; tries++) {
+      auto sent = std::chrono::steady_clock::now();
+      SubmitResult res = pool->stratum != nullptr
+                             ? submitwork(share, pool->stratum)
+                             : submitwork(share, pool->submitcurl);
+      std::chrono::duration<double, std::milli> rtt =
+          std::chrono::steady_clock::now() - sent;
+      if (res != SUBMIT_FAILED) {
+        pool->answered(rtt.count());
+        submitLatency.observe(rtt.count());
+        (res == SUBMIT_ACCEPTED ? pool->accepted : pool->rejected)++;
+        if (solomining && res == SUBMIT_ACCEPTED) {
+          logger->info("mined a block, accepted {:.1f}ms after it was found",
+                       queued.count() + rtt.count());
+          blockEpoch = share->epoch;
+          pool->wake();  // its template is out of date now
+        } else if (share->block) {
+          logger->info("block from thread {} sent to pool {} {:.1f}ms after "
+                       "it was found",
+                       share->thread_id, pool->index + 1,
+                       queued.count() + rtt.count());
+        }
+        break;
+      }
+      pool->failed();
+      if (tries == SUBMIT_TRIES || share->epoch != workChannel.epoch()) {
+        logger->warn("dropping share from thread {} after {} tries",
+                     share->thread_id, tries);
+        (share->epoch != workChannel.epoch() ? sharesStale : sharesDropped)++;
+        break;
+      }
+      logger->warn("submitwork failed, trying again in {}ms", backoff);
+      std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+      backoff *= 2;
+    }
+    delete share;
   }
-  return val.asBool();
 }
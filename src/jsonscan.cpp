@@ -0,0 +1,367 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "jsonscan.hpp"
+
+#include <errno.h>   // for errno, ERANGE
+#include <stdlib.h>  // for strtod
+#include <string.h>  // for memcmp, memcpy, memset, strlen
+
+#include <string>  // for string
+
+namespace {
+
+// deepest nesting skipped in the members the miner doesn't read
+const int SCAN_DEPTH = 32;
+
+// Cursor walks a buffer that is not zero terminated
+struct Cursor {
+  const char *p;
+  const char *end;
+  bool more() const { return p < end; }
+};
+
+void skipSpace(Cursor *c) {
+  while (c->more() &&
+         (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+    c->p++;
+  }
+}
+
+// skip whitespace, then take `ch` if it is next
+bool take(Cursor *c, char ch) {
+  skipSpace(c);
+  if (c->more() && *c->p == ch) {
+    c->p++;
+    return true;
+  }
+  return false;
+}
+
+bool literal(Cursor *c, const char *word) {
+  size_t n = strlen(word);
+  if (static_cast<size_t>(c->end - c->p) < n || memcmp(c->p, word, n) != 0) {
+    return false;
+  }
+  c->p += n;
+  return true;
+}
+
+int hexValue(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+// the XXXX of a \uXXXX escape, -1 if it isn't one
+long unicodeEscape(Cursor *c) {
+  if (c->end - c->p < 4) {
+    return -1;
+  }
+  long u = 0;
+  for (int i = 0; i < 4; i++) {
+    int h = hexValue(c->p[i]);
+    if (h < 0) {
+      return -1;
+    }
+    u = u * 16 + h;
+  }
+  c->p += 4;
+  return u;
+}
+
+// A string. Its raw contents go in *s and *n, `escaped` says whether it has
+// escapes, in which case they are not its value.
+bool scanString(Cursor *c, const char **s, size_t *n, bool *escaped) {
+  if (!take(c, '"')) {
+    return false;
+  }
+  *s = c->p;
+  *escaped = false;
+  while (c->more()) {
+    unsigned char ch = *c->p++;
+    if (ch == '"') {
+      *n = c->p - 1 - *s;
+      return true;
+    }
+    if (ch < 0x20) {
+      return false;
+    }
+    if (ch != '\\') {
+      continue;
+    }
+    *escaped = true;
+    if (!c->more()) {
+      return false;
+    }
+    ch = *c->p++;
+    if (ch != 'u') {
+      if (memchr("\"\\/bfnrt", ch, 8) == nullptr) {
+        return false;
+      }
+      continue;
+    }
+    long u = unicodeEscape(c);
+    // a high surrogate needs its low half right after it
+    if (u >= 0xd800 && u <= 0xdbff) {
+      if (!literal(c, "\\u")) {
+        return false;
+      }
+      u = unicodeEscape(c);
+      if (u < 0xdc00 || u > 0xdfff) {
+        return false;
+      }
+    }
+    if (u < 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+size_t skipDigits(Cursor *c) {
+  const char *start = c->p;
+  while (c->more() && *c->p >= '0' && *c->p <= '9') {
+    c->p++;
+  }
+  return c->p - start;
+}
+
+bool skipNumber(Cursor *c) {
+  const char *start = c->p;
+  if (c->more() && *c->p == '-') {
+    c->p++;
+  }
+  if (!c->more() || *c->p < '0' || *c->p > '9') {
+    return false;
+  }
+  if (*c->p == '0') {
+    c->p++;
+  } else {
+    skipDigits(c);
+  }
+  if (c->more() && *c->p == '.') {
+    c->p++;
+    if (skipDigits(c) == 0) {
+      return false;
+    }
+  }
+  if (c->more() && (*c->p == 'e' || *c->p == 'E')) {
+    c->p++;
+    if (c->more() && (*c->p == '+' || *c->p == '-')) {
+      c->p++;
+    }
+    if (skipDigits(c) == 0) {
+      return false;
+    }
+  }
+  // and fits a double, jsoncpp refuses 1e999
+  char num[64];
+  size_t n = c->p - start;
+  if (n >= sizeof(num)) {
+    return false;
+  }
+  memcpy(num, start, n);
+  num[n] = 0;
+  errno = 0;
+  strtod(num, nullptr);
+  return errno != ERANGE;
+}
+
+// any well formed value, `depth` levels down
+bool skipValue(Cursor *c, int depth) {
+  skipSpace(c);
+  if (!c->more()) {
+    return false;
+  }
+  const char *s;
+  size_t n;
+  bool escaped;
+  switch (*c->p) {
+    case '"':
+      return scanString(c, &s, &n, &escaped);
+    case '{':
+      if (depth >= SCAN_DEPTH) {
+        return false;
+      }
+      c->p++;
+      if (take(c, '}')) {
+        return true;
+      }
+      do {
+        if (!scanString(c, &s, &n, &escaped) || !take(c, ':') ||
+            !skipValue(c, depth + 1)) {
+          return false;
+        }
+      } while (take(c, ','));
+      return take(c, '}');
+    case '[':
+      if (depth >= SCAN_DEPTH) {
+        return false;
+      }
+      c->p++;
+      if (take(c, ']')) {
+        return true;
+      }
+      do {
+        if (!skipValue(c, depth + 1)) {
+          return false;
+        }
+      } while (take(c, ','));
+      return take(c, ']');
+    case 't':
+      return literal(c, "true");
+    case 'f':
+      return literal(c, "false");
+    case 'n':
+      return literal(c, "null");
+    default:
+      return skipNumber(c);
+  }
+}
+
+// The reply object. `result` scans the value of its "result" member, which
+// must be there exactly once.
+template <class F>
+bool scanReply(const char *buf, size_t len, F result) {
+  Cursor c = {buf, buf + len};
+  bool seen = false;
+  if (!take(&c, '{')) {
+    return false;
+  }
+  if (!take(&c, '}')) {
+    do {
+      const char *key;
+      size_t n;
+      bool escaped;
+      if (!scanString(&c, &key, &n, &escaped) || escaped || !take(&c, ':')) {
+        return false;
+      }
+      if (n == 6 && memcmp(key, "result", 6) == 0) {
+        if (seen || !result(&c)) {
+          return false;
+        }
+        seen = true;
+      } else if (!skipValue(&c, 1)) {
+        return false;
+      }
+    } while (take(&c, ','));
+    if (!take(&c, '}')) {
+      return false;
+    }
+  }
+  skipSpace(&c);
+  return seen && !c.more();
+}
+
+// optional 0x, then `min` to `max` hex digits
+bool isHex(const char *s, size_t n, bool prefix, size_t min, size_t max) {
+  if (n >= 2 && s[0] == '0' && s[1] == 'x') {
+    s += 2;
+    n -= 2;
+  } else if (prefix) {
+    return false;
+  }
+  if (n < min || n > max) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (hexValue(s[i]) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// check the four job strings and copy them into `job`
+bool makeJob(const char *const f[4], const size_t n[4], GetworkJob *job) {
+  if (!isHex(f[0], n[0], true, 64, 64) || n[1] < JOB_HEX_LEN ||
+      !isHex(f[2], n[2], false, 1, 64) || !isHex(f[3], n[3], false, 1, 64)) {
+    return false;
+  }
+  memset(job, 0, sizeof(*job));
+  memcpy(job->input, f[0], n[0]);
+  job->version = f[1][JOB_HEX_LEN - 1];
+  memcpy(job->target, f[2], n[2]);
+  memcpy(job->difficulty, f[3], n[3]);
+  return true;
+}
+
+// one job string, no escapes (hex never has any)
+bool scanField(Cursor *c, const char **s, size_t *n) {
+  bool escaped;
+  return scanString(c, s, n, &escaped) && !escaped;
+}
+
+bool scanJob(Cursor *c, GetworkJob *job) {
+  const char *f[4];
+  size_t n[4];
+  size_t i = 0;
+  if (!take(c, '[')) {
+    return false;
+  }
+  if (!take(c, ']')) {
+    do {
+      // anything after the four strings is ignored
+      if (i < 4 ? !scanField(c, &f[i], &n[i]) : !skipValue(c, 2)) {
+        return false;
+      }
+      i++;
+    } while (take(c, ','));
+    if (!take(c, ']')) {
+      return false;
+    }
+  }
+  return i >= 4 && makeJob(f, n, job);
+}
+
+}  // namespace
+
+bool scanGetwork(const char *buf, size_t len, GetworkJob *job) {
+  return scanReply(buf, len, [job](Cursor *c) { return scanJob(c, job); });
+}
+
+bool scanSubmit(const char *buf, size_t len, bool *accepted) {
+  return scanReply(buf, len, [accepted](Cursor *c) {
+    skipSpace(c);
+    if (literal(c, "true")) {
+      *accepted = true;
+      return true;
+    }
+    *accepted = false;
+    return literal(c, "false");
+  });
+}
+
+bool jobFromJson(const Json::Value &val, GetworkJob *job) {
+  if (!val.isArray() || val.size() < 4) {
+    return false;
+  }
+  std::string s[4];
+  const char *f[4];
+  size_t n[4];
+  for (Json::ArrayIndex i = 0; i < 4; i++) {
+    if (!val[i].isString()) {
+      return false;
+    }
+    s[i] = val[i].asString();
+    f[i] = s[i].data();
+    n[i] = s[i].size();
+  }
+  return makeJob(f, n, job);
+}
@@ -17,14 +17,26 @@
 
 #include <stdint.h>  // for uint8_t
 #include <stdlib.h>  // for srand, NULL
+#include <string.h>  // for strlen
 #include <time.h>    // for time
 
+#include <algorithm>        // for max
 #include <cli11/CLI11.hpp>  // for App, CLI11_PARSE
-#include <iostream>         // for basic_ostream, endl, cout
+#include <iostream>         // for basic_ostream, endl, cout, cerr
+#include <sstream>          // for stringstream
 #include <stdexcept>        // for invalid_argument, out_of_range
 #include <string>           // for string, operator<<
+#include <thread>           // for hardware_concurrency
+#include <vector>           // for vector
 
+#include "arena.hpp"                     // for arena_use_hugepages
+#include "autotune.hpp"                  // for autotune
+#include "bench.hpp"                     // for runBenchSuite
+#include "engine.hpp"                    // for aquahash_batch_select
 #include "miner.hpp"                     // for Miner
+#include "pool.hpp"                      // for parsePoolSpec
+#include "stratum.hpp"                   // for StratumClient
+#include "topology.hpp"                  // for pinOrder
 #include "spdlog/common.h"               // for debug
 #include "spdlog/details/log_msg-inl.h"  // for log_msg::log_msg
 #include "spdlog/spdlog-inl.h"           // for set_level
@@ -34,6 +46,7 @@
 #define VERSION "0.0.0-unknown"
 #endif
 
+using std::cerr;
 using std::cout;
 using std::endl;
 using std::string;
@@ -48,40 +61,237 @@ int main(int argc, char **argv) {
   bool showversion = false;
   bool solo = false;
   bool mkconfig = false;
-  string poolurl = "http://127.0.0.1:8543";
+  std::vector<string> poolArgs;  // POOL_DEFAULT_URL if none
+  bool poolSplit = false;
+  string metrics = "";
+  unsigned long long shareDiff = 0;
   uint8_t numThreads = 1;
   int numCPU = 1;
+  string kernel = "auto";
+  string pin = PIN_NONE;
+  bool hugepages = false;
+  string cpuList = "";
+  int batch = 1;
+  bool autotuneFlag = false;
+  bool retune = false;
+  string tuneCache = autotuneCachePath();
+  bool benchSuite = false;
+  string benchVersions = "2,3,4";
+  string benchKernels = "all";
+  string benchBatches = "1";
+  string benchThreads = "";
+  BenchConfig benchConfig;
+  benchConfig.trials = 5;
+  benchConfig.seconds = 1;
+  benchConfig.warmup = 0.5;
+  benchConfig.format = "text";
+  int noncePrefix = -1;
 
   // flags
   CLI::App app{appname};
   app.allow_config_extras(true);
   app.add_flag("-v,--verbose", verbose, "verbose logging");
-  app.add_flag("--solo", solo, "solomining: successful share = 1 block");
+  app.add_flag("--solo", solo,
+               "solomining on a local node: successful share = 1 block");
   app.add_flag("-V,--version", showversion, "show version and exit");
   app.add_flag("--mkconf", mkconfig,
                "create config based on given flags and exit");
   app.add_flag("-B,--bench", bench, "hash 1M times and quit");
-  app.add_option("-F,--pool", poolurl, "pool URL to mine to");
+  app.add_option("-F,--pool", poolArgs,
+                 "pool to mine to, http:// or stratum+tcp://host:port, with "
+                 "optional priority=N weight=N. Repeat for failover");
+  app.add_flag("--pool-split", poolSplit,
+               "split hashrate across pools of the same priority by weight");
+  app.add_option("--metrics", metrics,
+                 "serve Prometheus /metrics and /metrics.json on [host:]port");
+  app.add_option("--share-diff", shareDiff,
+                 "don't submit shares below this difficulty, 0 for the "
+                 "pool's. Blocks are always submitted");
   app.add_option("-t,--threads", numThreads, "number of threads to start");
   app.add_option("-C,--cores", numCPU, "number of CPU cores (dont touch)");
+  app.add_option("--nonce-prefix", noncePrefix,
+                 "rig id (0-65535) in the high nonce bits, random if unset");
+  app.add_option("--kernel", kernel,
+                 "hashing kernel: auto, avx512, avx2, sse2 or generic");
+  app.add_option("--pin", pin,
+                 "thread pinning: none, compact, scatter or cores");
+  app.add_option("--cpu-list", cpuList,
+                 "pin threads to these cpus in order, like 0,2,4-7");
+  app.add_option("--batch", batch, "nonces per hash call, in kernel widths");
+  app.add_flag("--hugepages", hugepages,
+               "hashing memory on 2 MiB huge pages, if the system has them");
+  app.add_flag("--autotune", autotuneFlag,
+               "use this cpu's tuned settings, tuning first if there are none");
+  app.add_flag("--retune", retune, "tune for this cpu, save it and quit");
+  app.add_option("--autotune-cache", tuneCache, "where tuned settings live");
+  // --bench-suite and its knobs, kept out of the config file
+  std::vector<CLI::Option *> benchOptions = {
+      app.add_flag("--bench-suite", benchSuite,
+                   "sweep versions, kernels, batches and threads, then quit"),
+      app.add_option("--bench-versions", benchVersions,
+                     "aquahash versions to benchmark, comma separated"),
+      app.add_option("--bench-kernels", benchKernels,
+                     "kernels to benchmark, or all (includes reference)"),
+      app.add_option("--bench-batches", benchBatches,
+                     "nonces per call to benchmark, in kernel widths"),
+      app.add_option("--bench-threads", benchThreads,
+                     "thread counts to benchmark, default 1 2 4 .. cpus"),
+      app.add_option("--bench-trials", benchConfig.trials,
+                     "timed trials per combination"),
+      app.add_option("--bench-seconds", benchConfig.seconds,
+                     "seconds per trial"),
+      app.add_option("--bench-warmup", benchConfig.warmup,
+                     "seconds of warmup per combination"),
+      app.add_option("--bench-format", benchConfig.format,
+                     "benchmark output: text, json or csv"),
+  };
   app.set_config("-c,--conf", filename, "Read a TOML config file", false);
   CLI11_PARSE(app, argc, argv);
   srand(time(NULL));
 
-  if (mkconfig) {
+  // the config as a file, without --mkconf and the --bench-* options
+  auto configText = [&app, &benchOptions]() {
     app.remove_option(app.get_option("--mkconf"));
-    return cout << app.config_to_str(true, true) ? 0 : 111;
+    for (CLI::Option *opt : benchOptions) {
+      app.remove_option(opt);
+    }
+    return app.config_to_str(true, true);
+  };
+
+  if (mkconfig) {
+    return cout << configText() ? 0 : 111;
   }
   if (showversion) {
     return cout << appname << endl ? 0 : 222;
   }
 
+  // pick hashing kernel before any threads start
+  if (!aquahash_batch_select(kernel)) {
+    cerr << "kernel '" << kernel << "' is unknown or unsupported on this cpu"
+         << " (try: auto " << aquahash_batch_kernels() << ")" << endl;
+    return 111;
+  }
+
+  if (poolArgs.empty()) {
+    poolArgs.push_back(POOL_DEFAULT_URL);
+  }
+  std::vector<PoolSpec> pools;
+  for (const string &arg : poolArgs) {
+    PoolSpec spec;
+    std::string stratumHost, stratumPort;
+    if (!parsePoolSpec(arg, &spec)) {
+      cerr << "bad pool '" << arg << "', must look like URL [priority=N] "
+           << "[weight=N]" << endl;
+      return 111;
+    }
+    if (spec.url.compare(0, strlen(STRATUM_SCHEME), STRATUM_SCHEME) == 0 &&
+        !StratumClient::parseUrl(spec.url, &stratumHost, &stratumPort)) {
+      cerr << "stratum pool url must look like " STRATUM_SCHEME "host:port"
+           << endl;
+      return 111;
+    }
+    pools.push_back(spec);
+  }
+
+  if (noncePrefix > 0xffff) {
+    cerr << "nonce prefix must be 0-65535" << endl;
+    return 111;
+  }
+
+  if (!pinPolicyKnown(pin)) {
+    cerr << "pinning must be " PIN_NONE ", " PIN_COMPACT ", " PIN_SCATTER
+            " or " PIN_CORES
+         << endl;
+    return 111;
+  }
+  std::vector<int> pinCpus;
+  if (!cpuList.empty() && !parseCpuList(cpuList, &pinCpus)) {
+    cerr << "bad cpu list '" << cpuList << "'" << endl;
+    return 111;
+  }
+  if (batch < 1 || batch > 16) {
+    cerr << "batch must be 1-16" << endl;
+    return 111;
+  }
+
+  arena_use_hugepages(hugepages);
+
+  // thread count, pinning, kernel and batch measured on this kind of cpu.
+  // Flags given on the command line or in the config file still win.
+  if (autotuneFlag || retune) {
+    const string key = autotuneKey();
+    TuneResult tuned;
+    bool cached = !retune && autotuneLoad(tuneCache, key, &tuned) &&
+                  aquahash_batch_select(tuned.kernel);
+    if (!cached) {
+      cerr << "autotuning for " << key << ", this takes a minute" << endl;
+      tuned = autotune(AUTOTUNE_SECONDS);
+      // an empty kernel means every one failed its selftest: retune next run
+      if (!tuned.kernel.empty() && !autotuneSave(tuneCache, key, tuned)) {
+        cerr << "can't save tuned settings to " << tuneCache << endl;
+      }
+    }
+    cerr << "autotune" << (cached ? " (cached)" : "") << ": " << tuned.threads
+         << " threads, pin " << tuned.pinning << ", kernel "
+         << (tuned.kernel.empty() ? BENCH_REFERENCE : tuned.kernel)
+         << ", batch " << tuned.batch << " (" << tuned.rate / 1000
+         << " kH/s at v" << AUTOTUNE_VERSION << ")" << endl;
+    if (retune) {
+      return 0;
+    }
+    if (app.count("--threads") == 0) {
+      numThreads = static_cast<uint8_t>(std::min(tuned.threads, 255));
+    }
+    if (app.count("--pin") == 0) {
+      pin = tuned.pinning;
+    }
+    if (app.count("--batch") == 0) {
+      batch = tuned.batch;
+    }
+    aquahash_batch_select(app.count("--kernel") == 0 ? tuned.kernel : kernel);
+  }
+
+  if (benchSuite) {
+    // with --hugepages, normal and huge pages side by side
+    benchConfig.hugepages = hugepages;
+    if (benchKernels == "all") {
+      benchKernels = aquahash_batch_kernels() + " " BENCH_REFERENCE;
+    }
+    std::stringstream kernels(benchKernels);
+    for (string k; kernels >> k;) {
+      benchConfig.kernels.push_back(k);
+    }
+    if (benchThreads.empty()) {
+      int cpus = std::max(1U, std::thread::hardware_concurrency());
+      for (int n = 1; n < cpus; n *= 2) {
+        benchThreads += std::to_string(n) + ",";
+      }
+      benchThreads += std::to_string(cpus);
+    }
+    if (!parseBenchList(benchVersions, &benchConfig.versions) ||
+        !parseBenchList(benchBatches, &benchConfig.batches) ||
+        !parseBenchList(benchThreads, &benchConfig.threads) ||
+        benchConfig.trials < 1 || benchConfig.seconds <= 0 ||
+        (benchConfig.format != "text" && benchConfig.format != "json" &&
+         benchConfig.format != "csv")) {
+      cerr << "bad --bench-* option" << endl;
+      return 111;
+    }
+    return runBenchSuite(benchConfig);
+  }
+
   // print config
-  app.remove_option(app.get_option("--mkconf"));
-  cout << app.config_to_str(true, true);
+  cout << configText();
+
+  // an explicit cpu list beats any policy
+  if (pinCpus.empty()) {
+    pinCpus = pinOrder(pin, cpuTopology());
+  }
 
   // start mining
-  Miner *miner = new Miner(poolurl, numThreads, numCPU, verbose, bench, solo);
+  Miner *miner =
+      new Miner(pools, poolSplit, numThreads, numCPU, verbose, bench, solo,
+                noncePrefix, pinCpus, batch, metrics, shareDiff);
   cout << appname << endl << sourcelink << endl;
   if (verbose) {
     spdlog::set_level(spdlog::level::debug);
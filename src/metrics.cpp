@@ -0,0 +1,389 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "metrics.hpp"
+
+#include <arpa/inet.h>            // for inet_pton, htons
+#include <jsoncpp/json/value.h>   // for Value
+#include <jsoncpp/json/writer.h>  // for StreamWriterBuilder
+#include <netinet/in.h>           // for sockaddr_in
+#include <poll.h>                 // for poll
+#include <spdlog/fmt/fmt.h>       // for format
+#include <stdlib.h>               // for strtol
+#include <string.h>               // for memset
+#include <sys/socket.h>           // for socket, bind, listen, accept, send
+#include <unistd.h>               // for close, read
+
+#include <chrono>  // for steady_clock
+
+// how long a scraper gets to send its request
+#define METRICS_READ_MS (1000)
+
+static const double bucketBounds[METRICS_NUM_BUCKETS] = METRICS_BUCKETS;
+
+LatencyHistogram::LatencyHistogram() : sumMicros(0) {
+  for (auto &b : buckets) {
+    b.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::observe(double ms) {
+  double sec = ms / 1000;
+  int i = 0;
+  while (i < METRICS_NUM_BUCKETS && sec > bucketBounds[i]) {
+    i++;
+  }
+  buckets[i].fetch_add(1, std::memory_order_relaxed);
+  sumMicros.fetch_add(static_cast<unsigned long long>(ms * 1000),
+                      std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+  Snapshot s;
+  s.count = 0;
+  for (int i = 0; i <= METRICS_NUM_BUCKETS; i++) {
+    s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    s.count += s.buckets[i];
+  }
+  s.sum = sumMicros.load(std::memory_order_relaxed) / 1e6;
+  return s;
+}
+
+namespace {
+
+// Prometheus label value, quoted
+std::string label(const std::string &value) {
+  std::string out = "\"";
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+void head(std::string *out, const char *name, const char *type,
+          const char *help) {
+  *out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void histogram(std::string *out, const char *name, const char *help,
+               const LatencyHistogram::Snapshot &h) {
+  head(out, name, "histogram", help);
+  unsigned long long cumulative = 0;
+  for (int i = 0; i < METRICS_NUM_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    *out += fmt::format("{}_bucket{{le=\"{}\"}} {}\n", name, bucketBounds[i],
+                        cumulative);
+  }
+  *out += fmt::format("{}_bucket{{le=\"+Inf\"}} {}\n{}_sum {}\n{}_count {}\n",
+                      name, h.count, name, h.sum, name, h.count);
+}
+
+Json::Value histogramJson(const LatencyHistogram::Snapshot &h) {
+  Json::Value v;
+  Json::Value buckets(Json::arrayValue);
+  for (int i = 0; i <= METRICS_NUM_BUCKETS; i++) {
+    Json::Value b;
+    b["le"] = i < METRICS_NUM_BUCKETS ? Json::Value(bucketBounds[i])
+                                      : Json::Value("+Inf");
+    b["count"] = static_cast<Json::UInt64>(h.buckets[i]);
+    buckets.append(b);
+  }
+  v["buckets"] = buckets;
+  v["count"] = static_cast<Json::UInt64>(h.count);
+  v["sum"] = h.sum;
+  return v;
+}
+
+// averagesJson is the moving averages of one hashrate, by window
+Json::Value averagesJson(const HashRates &r) {
+  Json::Value v;
+  v["1m"] = r.m1;
+  v["5m"] = r.m5;
+  v["15m"] = r.m15;
+  return v;
+}
+
+}  // namespace
+
+std::string metricsText(const MetricsSnapshot &m) {
+  std::string out;
+  head(&out, "aquaminer_info", "gauge", "Miner version and hashing kernel.");
+  out += fmt::format("aquaminer_info{{version={},kernel={}}} 1\n",
+                     label(m.version), label(m.kernel));
+  head(&out, "aquaminer_uptime_seconds", "counter", "Seconds since start.");
+  out += fmt::format("aquaminer_uptime_seconds {}\n", m.uptime);
+  head(&out, "aquaminer_hashrate", "gauge",
+       "Hashes per second over the last second.");
+  out += fmt::format("aquaminer_hashrate {}\n", m.hashrate.now);
+  head(&out, "aquaminer_hashrate_average", "gauge",
+       "Hashes per second, moving average by window.");
+  out += fmt::format(
+      "aquaminer_hashrate_average{{window=\"1m\"}} {}\n"
+      "aquaminer_hashrate_average{{window=\"5m\"}} {}\n"
+      "aquaminer_hashrate_average{{window=\"15m\"}} {}\n",
+      m.hashrate.m1, m.hashrate.m5, m.hashrate.m15);
+  head(&out, "aquaminer_hashes_total", "counter", "Hashes computed.");
+  out += fmt::format("aquaminer_hashes_total {}\n", m.hashes);
+  head(&out, "aquaminer_thread_hashrate", "gauge",
+       "Hashes per second of each miner thread.");
+  for (size_t i = 0; i < m.threadHashrate.size(); i++) {
+    out += fmt::format("aquaminer_thread_hashrate{{thread=\"{}\"}} {}\n",
+                       i + 1, m.threadHashrate[i].now);
+  }
+  head(&out, "aquaminer_thread_hashrate_average", "gauge",
+       "Hashes per second of each miner thread, moving average by window.");
+  for (size_t i = 0; i < m.threadHashrate.size(); i++) {
+    const HashRates &r = m.threadHashrate[i];
+    out += fmt::format(
+        "aquaminer_thread_hashrate_average{{thread=\"{}\",window=\"1m\"}} {}\n"
+        "aquaminer_thread_hashrate_average{{thread=\"{}\",window=\"5m\"}} {}\n"
+        "aquaminer_thread_hashrate_average{{thread=\"{}\",window=\"15m\"}} "
+        "{}\n",
+        i + 1, r.m1, i + 1, r.m5, i + 1, r.m15);
+  }
+  head(&out, "aquaminer_version_hashrate", "gauge",
+       "Hashes per second on each aquahash version.");
+  for (const auto &v : m.versionHashrate) {
+    out += fmt::format("aquaminer_version_hashrate{{version=\"{}\"}} {}\n",
+                       v.first, v.second);
+  }
+  head(&out, "aquaminer_solutions_total", "counter",
+       "Solutions found, by the target they met.");
+  out += fmt::format(
+      "aquaminer_solutions_total{{kind=\"share\"}} {}\n"
+      "aquaminer_solutions_total{{kind=\"block\"}} {}\n",
+      m.foundShares, m.foundBlocks);
+  head(&out, "aquaminer_shares_total", "counter",
+       "Shares found, by what became of them.");
+  out += fmt::format(
+      "aquaminer_shares_total{{result=\"accepted\"}} {}\n"
+      "aquaminer_shares_total{{result=\"rejected\"}} {}\n"
+      "aquaminer_shares_total{{result=\"stale\"}} {}\n"
+      "aquaminer_shares_total{{result=\"dropped\"}} {}\n",
+      m.accepted, m.rejected, m.stale, m.dropped);
+  head(&out, "aquaminer_pool_errors_total", "counter",
+       "Pool replies that could not be understood.");
+  out += fmt::format("aquaminer_pool_errors_total {}\n", m.errors);
+  head(&out, "aquaminer_pool_up", "gauge",
+       "1 if the pool is answering, by pool. active=1 is being mined.");
+  for (size_t i = 0; i < m.pools.size(); i++) {
+    const MetricsSnapshot::Pool &p = m.pools[i];
+    out += fmt::format(
+        "aquaminer_pool_up{{pool=\"{}\",url={},active=\"{}\"}} {}\n", i + 1,
+        label(p.url), p.active ? 1 : 0, p.up ? 1 : 0);
+  }
+  head(&out, "aquaminer_pool_latency_seconds", "gauge",
+       "Average pool round trip, by pool.");
+  for (size_t i = 0; i < m.pools.size(); i++) {
+    out += fmt::format("aquaminer_pool_latency_seconds{{pool=\"{}\"}} {}\n",
+                       i + 1, m.pools[i].latency / 1000);
+  }
+  head(&out, "aquaminer_pool_error_ratio", "gauge",
+       "Recent share of failed pool requests, by pool.");
+  for (size_t i = 0; i < m.pools.size(); i++) {
+    out += fmt::format("aquaminer_pool_error_ratio{{pool=\"{}\"}} {}\n", i + 1,
+                       m.pools[i].errorRate);
+  }
+  head(&out, "aquaminer_pool_shares_total", "counter",
+       "Shares the pool answered, by pool.");
+  for (size_t i = 0; i < m.pools.size(); i++) {
+    out += fmt::format(
+        "aquaminer_pool_shares_total{{pool=\"{}\",result=\"accepted\"}} {}\n"
+        "aquaminer_pool_shares_total{{pool=\"{}\",result=\"rejected\"}} {}\n",
+        i + 1, m.pools[i].accepted, i + 1, m.pools[i].rejected);
+  }
+  histogram(&out, "aquaminer_getwork_latency_seconds",
+            "Getwork round trips.", m.getwork);
+  histogram(&out, "aquaminer_submit_latency_seconds",
+            "Share submit round trips.", m.submit);
+  histogram(&out, "aquaminer_work_switch_seconds",
+            "New work published until every miner thread hashes it.",
+            m.workSwitch);
+  return out;
+}
+
+std::string metricsJson(const MetricsSnapshot &m) {
+  Json::Value v;
+  v["version"] = m.version;
+  v["kernel"] = m.kernel;
+  v["uptime"] = m.uptime;
+  v["hashrate"] = m.hashrate.now;
+  v["hashrateAverage"] = averagesJson(m.hashrate);
+  v["hashes"] = static_cast<Json::UInt64>(m.hashes);
+  Json::Value threads(Json::arrayValue);
+  Json::Value threadAverages(Json::arrayValue);
+  for (const HashRates &rate : m.threadHashrate) {
+    threads.append(rate.now);
+    threadAverages.append(averagesJson(rate));
+  }
+  v["threadHashrate"] = threads;
+  v["threadHashrateAverage"] = threadAverages;
+  Json::Value versions(Json::objectValue);
+  for (const auto &ver : m.versionHashrate) {
+    versions[std::string(1, ver.first)] = ver.second;
+  }
+  v["versionHashrate"] = versions;
+  Json::Value found;
+  found["share"] = static_cast<Json::UInt64>(m.foundShares);
+  found["block"] = static_cast<Json::UInt64>(m.foundBlocks);
+  v["solutions"] = found;
+  Json::Value shares;
+  shares["accepted"] = static_cast<Json::UInt64>(m.accepted);
+  shares["rejected"] = static_cast<Json::UInt64>(m.rejected);
+  shares["stale"] = static_cast<Json::UInt64>(m.stale);
+  shares["dropped"] = static_cast<Json::UInt64>(m.dropped);
+  v["shares"] = shares;
+  v["errors"] = static_cast<Json::UInt64>(m.errors);
+  Json::Value pools(Json::arrayValue);
+  for (const MetricsSnapshot::Pool &p : m.pools) {
+    Json::Value pv;
+    pv["url"] = p.url;
+    pv["active"] = p.active;
+    pv["up"] = p.up;
+    pv["latencyMs"] = p.latency;
+    pv["errorRate"] = p.errorRate;
+    pv["accepted"] = static_cast<Json::UInt64>(p.accepted);
+    pv["rejected"] = static_cast<Json::UInt64>(p.rejected);
+    pools.append(pv);
+  }
+  v["pools"] = pools;
+  Json::Value latency;
+  latency["getwork"] = histogramJson(m.getwork);
+  latency["submit"] = histogramJson(m.submit);
+  latency["workSwitch"] = histogramJson(m.workSwitch);
+  v["latency"] = latency;
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "";
+  writer["precision"] = 10;
+  return Json::writeString(writer, v) + "\n";
+}
+
+MetricsServer::MetricsServer() : listenfd(-1), boundPort(0), running(false) {}
+
+MetricsServer::~MetricsServer() { stop(); }
+
+bool MetricsServer::start(const std::string &listenAddr, Render renderFn) {
+  std::string host = "127.0.0.1";
+  std::string portStr = listenAddr;
+  size_t colon = listenAddr.rfind(':');
+  if (colon != std::string::npos) {
+    host = listenAddr.substr(0, colon);
+    portStr = listenAddr.substr(colon + 1);
+  }
+  char *end = nullptr;
+  long p = strtol(portStr.c_str(), &end, 10);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(p));
+  if (portStr.empty() || *end != 0 || p < 0 || p > 65535 ||
+      inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+    return false;
+  }
+  listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenfd < 0) {
+    return false;
+  }
+  int one = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  socklen_t len = sizeof(addr);
+  if (bind(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listenfd, 16) != 0 ||
+      getsockname(listenfd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+    close(listenfd);
+    listenfd = -1;
+    return false;
+  }
+  boundPort = ntohs(addr.sin_port);
+  render = renderFn;
+  running = true;
+  acceptor = std::thread(&MetricsServer::acceptLoop, this);
+  return true;
+}
+
+void MetricsServer::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  acceptor.join();
+  close(listenfd);
+  listenfd = -1;
+}
+
+void MetricsServer::acceptLoop() {
+  while (running) {
+    pollfd p = {listenfd, POLLIN, 0};
+    if (poll(&p, 1, 100) <= 0) {
+      continue;
+    }
+    int fd = accept(listenfd, nullptr, nullptr);
+    if (fd >= 0) {
+      serve(fd);
+      close(fd);
+    }
+  }
+}
+
+// one request, then the connection is closed
+void MetricsServer::serve(int fd) {
+  std::string in;
+  char buf[1024];
+  auto until = std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(METRICS_READ_MS);
+  while (in.find("\r\n\r\n") == std::string::npos && in.size() < 8192) {
+    int ms = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            until - std::chrono::steady_clock::now())
+            .count());
+    pollfd p = {fd, POLLIN, 0};
+    if (ms <= 0 || poll(&p, 1, ms) <= 0) {
+      return;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      return;
+    }
+    in.append(buf, n);
+  }
+  std::string path;
+  if (in.compare(0, 4, "GET ") == 0) {
+    path = in.substr(4, in.find_first_of(" ?\r", 4) - 4);
+  }
+  std::string status = "200 OK", type, body;
+  if (path == "/metrics") {
+    type = "text/plain; version=0.0.4";
+    body = metricsText(render());
+  } else if (path == "/metrics.json") {
+    type = "application/json";
+    body = metricsJson(render());
+  } else {
+    status = "404 Not Found";
+    type = "text/plain";
+    body = "try /metrics or /metrics.json\n";
+  }
+  std::string out = fmt::format(
+      "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+      "Connection: close\r\n\r\n{}",
+      status, type, body.size(), body);
+  send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+}
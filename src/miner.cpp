@@ -16,20 +16,23 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <aquahash.h>  // for argon2_context, arg...
-#include <gmp.h>       // for mpz_init, mpz_cmp
+#include <gmp.h>       // for mpz_init, mpz_cmp, mpz_clear
 #include <stdint.h>    // for uint8_t, uint32_t
 #include <stdio.h>     // for printf
 #include <stdlib.h>    // for malloc, exit, EXIT_...
 
 #include <chrono>   // for milliseconds
-#include <cstring>  // for memcpy
-#include <random>   // for mt19937_64, random_...
+#include <cstring>  // for memcpy, strcmp
 #include <thread>   // for thread, sleep_for
 //#include <utility>  // for move
 #include <vector>  // for vector
 
-#include "aqua.hpp"                               // for mpz_fromBytesNoInit
+#include "aqua.hpp"                               // for hashMeetsTarget
+#include "arena.hpp"                              // for HashArena
+#include "engine.hpp"                             // for aquahash_batch_...
 #include "miner.hpp"                              // for Miner
+#include "nonce.hpp"                              // for NonceRange
+#include "topology.hpp"                           // for pinThread
 #include "spdlog/common.h"                        // for debug
 #include "spdlog/logger.h"                        // for logger
 #include "spdlog/sinks/ansicolor_sink-inl.h"      // for ansicolor_sink::pri...
@@ -61,8 +64,14 @@ int aquahash_version(void *output, const void *input, uint32_t mem) {
   context.secretlen = 0;
   context.ad = nullptr;
   context.adlen = 0;
-  context.allocate_cbk = nullptr;
-  context.free_cbk = nullptr;
+  if (HashArena::current() != nullptr) {
+    // hash in the calling thread's arena instead of malloc/free per nonce
+    context.allocate_cbk = arena_allocate;
+    context.free_cbk = arena_deallocate;
+  } else {
+    context.allocate_cbk = nullptr;
+    context.free_cbk = nullptr;
+  }
   context.flags = ARGON2_DEFAULT_FLAGS;
   context.m_cost = mem;
   context.lanes = 1;
@@ -72,6 +81,29 @@ int aquahash_version(void *output, const void *input, uint32_t mem) {
   return argon2_ctx(&context, Argon2_id);
 }
 
+// hashes per second on the calling thread, hashing in a fresh arena
+// (useArena) or letting libaquahash malloc and free for every nonce
+double aquahash_rate(uint32_t mem, unsigned long long n, bool useArena) {
+  uint8_t in[HASH_INPUT_LEN] = {0};
+  uint8_t out[HASH_LEN];
+  HashArena arena;
+  if (useArena) {
+    arena.reserve(aquahash_memsize(mem));
+    arena.bind();
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (unsigned long long i = 0; i < n; i++) {
+    memcpy(&in[32], &i, 8);
+    if (ARGON2_OK != aquahash_version(out, in, mem)) {
+      return 0;
+    }
+  }
+  std::chrono::duration<double> dur =
+      std::chrono::high_resolution_clock::now() - t1;
+  arena.unbind();
+  return n / dur.count();
+}
+
 #define handle_error_en(en, msg) \
   do {                           \
     errno = en;                  \
@@ -79,27 +111,7 @@ int aquahash_version(void *output, const void *input, uint32_t mem) {
     exit(EXIT_FAILURE);          \
   } while (0)
 
-#ifdef AFFINE
-static void affine_to_cpu_mask(int id, unsigned long mask, int num_cpus) {
-  cpu_set_t set;
-  CPU_ZERO(&set);
-  for (uint8_t i = 0; i < num_cpus; i++) {
-    // cpu mask
-    if (mask & (1UL << i)) {
-      CPU_SET(i, &set);
-    }
-  }
-  if (id == -1) {
-    // process affinity
-    sched_setaffinity(0, sizeof(&set), &set);
-  } else {
-    // thread only
-    // pthread_setaffinity_np(, sizeof(&set), &set);
-  }
-}
-#endif
 void Miner::minerThread(uint8_t thread_id) {
-  static const bool verbose = this->verbose;
   logger->debug("thread {} started\n", thread_id);
 
 #ifdef SCHEDPOL
@@ -127,141 +139,208 @@ void Miner::minerThread(uint8_t thread_id) {
                sch.sched_priority, policy);
 #endif
 
-  logger->info("Binding thread {} to cpu {} (mask {})", thread_id,
-               thread_id % num_cpus, (1 << ((thread_id - 1) % num_cpus)));
-
-#ifdef AFFINE
-  affine_to_cpu_mask(thread_id, 1UL << ((thread_id - 1) % num_cpus), num_cpus);
-#endif
+  // before the arena is touched, so its pages land on this cpu's node
+  if (!pinCpus.empty()) {
+    int cpu = pinCpus[(thread_id - 1) % pinCpus.size()];
+    if (pinThread(cpu)) {
+      logger->info("Binding thread {} to cpu {}", thread_id, cpu);
+    } else {
+      logger->warn("can't bind thread {} to cpu {}", thread_id, cpu);
+    }
+  }
 
   // create new WorkPacket to store work variables
   WorkPacket *work = new WorkPacket();
 
-  // random nonce
-  std::random_device engine;
-  std::mt19937_64 prng;
-  uint64_t n = std::random_device{}();
-  prng.seed(n);
-  memcpy(&work->buf[32], &n, 4);
-  prng.seed(n);
-  memcpy(&work->buf[36], &n, 4);
+  // argon2 working memory for this thread, reused for every hash
+  HashArena arena;
+  arena.bind();
+  uint32_t arenaMem = 0;
+
+  // this thread's own slice of the nonce space, restarted on new work
+  NonceRange nonceRange = nonces->assign(thread_id);
+  uint64_t nonceUsed = 0;  // on ranges already used up for this work
 
   // initialize variables
   mpz_t mpz_result;
   mpz_init(mpz_result);
 
-  uint64_t nonce_int = 0;
-  uint64_t tries = 0;
   uint64_t triesHashes = 0;
 
-  // so all the threads dont report at the same time
+  // nonces hashed side by side per aquahash_batch() call
+  const size_t lanes = hashLanes;
+  std::vector<uint8_t> batchInBuf(lanes * HASH_INPUT_LEN);
+  std::vector<uint8_t> batchOutBuf(lanes * HASH_LEN);
+  uint8_t *batchIn = batchInBuf.data();
+  uint8_t *batchOut = batchOutBuf.data();
+  // H0 hashing shared by every nonce of the current work
+  AquahashMidstate mid;
+  uint64_t midEpoch = 0;
+
+  // hashes between nonces->record calls, a little different per thread
   uint64_t reportTriesMod = static_cast<uint64_t>(thread_id + (1 * 1000));
-  // starting nonce
-  memcpy(&nonce_int, &work->buf[32], 8);
-  logger->info("Thread {} starting nonce: {}", thread_id, nonce_int);
-  memcpy(&work->buf[32], &nonce_int, 8);
+  logger->info("Thread {} nonce range {:016x}", thread_id, nonceRange.start);
 
   // miner loop
   while (true) {
-    // roll nonce
-    memcpy(&nonce_int, &work->buf[32], 8);
-    nonce_int++;
-    memcpy(&work->buf[32], &nonce_int, 8);
-
-#ifdef NONCEDEBUG
-    printf("NEWNONCE:");
-    print_hex(&work->buf[32], 8);
-#endif
-
-    if (tries % 100000 == 0) {
-      // see if we got new work
+    // see if we got new work, one relaxed load per batch
+    if (workChannel.epoch() != work->epoch) {
+      uint64_t lastEpoch = work->epoch;
+      std::shared_ptr<const Work> last = work->job;
       if (!this->getCurrentWork(work, thread_id)) {
         logger->info("getCurrentWork failed");
-        logger->debug("getCurrentWork({}, {})...", work->inputStr, thread_id);
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        workChannel.wait(work->epoch, 1000);
         continue;
       }
-      tries = 0;
+      switchClock->switched(thread_id, work->epoch);
+      if (last != nullptr &&
+          0 == strcmp(last->inputStr, work->job->inputStr)) {
+        // same job at a new share target, its nonces were already tried
+        continue;
+      }
+      // new work, start the range over
+      if (lastEpoch != 0) {
+        logger->debug("thread {} used {} nonces of the last work", thread_id,
+                      nonceUsed + nonceRange.used());
+      }
+      nonceRange = nonces->assign(thread_id);
+      nonceUsed = 0;
     }
 
-    // report hashrate every 10k hashes (per thread)
-    if (triesHashes % 20000 == reportTriesMod) {
-      this->numTries += triesHashes;
+    // note nonces used every 1000ish hashes (per thread)
+    if (triesHashes >= reportTriesMod) {
       triesHashes = 0;
+      nonces->record(thread_id, nonceUsed + nonceRange.used());
     }
-    tries++;
+
+    // the job stays alive while this thread points at it
+    const Work *job = work->job.get();
+    char version = job != nullptr ? job->version : 0;
 
     // Aquahash Version Switch (See Aquachain HF)
     //
     // TODO: move this to aquahash_version()
     uint32_t mem = 1;
-    if (work->version == '2') {
-    } else if (work->version == '3') {
+    if (version == '2') {
+    } else if (version == '3') {
       mem = 16;
-    } else if (work->version == '4') {
+    } else if (version == '4') {
       mem = 32;
-    } else if (work->version == 0 || work->version == '0') {
-      printf("thread %d going to sleep for 1 sec (no work yet)\n", thread_id);
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    } else if (version == 0 || version == '0') {
+      printf("thread %d waiting up to 1 sec for work\n", thread_id);
+      workChannel.wait(work->epoch, 1000);
       continue;
-    } else if (benching && work->version == '!') {
+    } else if (benching && version == '!') {
       break;
     } else {
-      printf("thread %d going to sleep for 1 sec (no work: '%c')\n", thread_id,
-             work->version);
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      printf("thread %d waiting up to 1 sec for work (no work: '%c')\n",
+             thread_id, version);
+      workChannel.wait(work->epoch, 1000);
       continue;
     }
 
-    // hash it
-    //
-    // TODO: accept work->version char as 3rd arg
-    if (ARGON2_OK != aquahash_version(work->output, work->buf, mem)) {
-      printf("argon2 failed\n");
-      exit(111);
+    // grow the arena only when switching to a bigger version
+    if (mem > arenaMem) {
+      size_t need = useEngine ? aquahash_batch_memsize(mem)
+                              : aquahash_memsize(mem);
+      if (!arena.reserve(need)) {
+        printf("thread %d can't allocate %u KiB arena\n", thread_id, mem);
+        exit(111);
+      }
+      logger->debug("thread {} arena now {} bytes", thread_id, arena.size());
+      arenaMem = mem;
+    }
+    if (useEngine && midEpoch != work->epoch) {
+      aquahash_midstate(&mid, work->buf, mem);
+      midEpoch = work->epoch;
     }
-    triesHashes++;
 
-    // TODO: memcmp
-    mpz_fromBytesNoInit(work->output, HASH_LEN, mpz_result);
-    if (mpz_cmp(mpz_result, work->target) > 0) {
-      // reloop
-      continue;
+    // next nonces, one per lane
+    uint64_t nonce = 0;
+    if (!nonceRange.take(lanes, &nonce)) {
+      nonceUsed += nonceRange.used();
+      nonceRange = nonces->extend(thread_id);
+      logger->warn("thread {} used up its nonce range, moving to {:016x}",
+                   thread_id, nonceRange.start);
+      nonceRange.take(lanes, &nonce);
     }
-#ifdef DEBUG
-    printf("thread %d mining version %c (input=%s)\n", thread_id, work->version,
-           work->inputStr);
-    printf("input from thread %d: ", thread_id);
-    print_hex(work->buf, 40);
-    printf("\n");
-    printf("output from thread %d: ", thread_id);
-    print_hex(work->output, 32);
-    printf("\n");
-    printf("nonce from thread %d:", thread_id);
-    print_hex(&work->buf[32], 8);
-    printf("\n");
-    printf("diff target from thread %d:", thread_id);
-    std::string diff = mpzToString(work->difficulty);
-    std::cout << diff << std::endl;
+
+#ifdef NONCEDEBUG
+    printf("NEWNONCE:");
+    print_hex(reinterpret_cast<uint8_t *>(&nonce), 8);
 #endif
-    logger->info("thread {} found new solution", thread_id);
-    // std::thread(submitwork, work, poolUrl).detach();
-    CURL *tmpsubmitcurl = curl_easy_init();
-    this->initcurl(tmpsubmitcurl, 2);
-    bool poolret = submitwork(work, poolUrl, verbose, tmpsubmitcurl);
-    curl_easy_cleanup(tmpsubmitcurl);
-    if (!poolret) {
-      logger->warn("submitwork failed, this miner thread sleeping 2s");
-      std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-      continue;
+
+    // hash them
+    if (useEngine) {
+      aquahash_batch_nonces(batchOut, mid, nonce, lanes, arena.data());
+    } else {
+      for (size_t k = 0; k < lanes; k++) {
+        uint64_t lane_nonce = nonce + k;
+        memcpy(&batchIn[k * HASH_INPUT_LEN], work->buf, 32);
+        memcpy(&batchIn[k * HASH_INPUT_LEN + 32], &lane_nonce, 8);
+        if (ARGON2_OK != aquahash_version(&batchOut[k * HASH_LEN],
+                                          &batchIn[k * HASH_INPUT_LEN], mem)) {
+          printf("argon2 failed\n");
+          exit(111);
+        }
+      }
     }
-    if (solomining) {
-      work->version = 0;  // pauses
-      logger->info(
-          "mined a block. sleeping 1 second for getwork thread to catch up");
-      continue;
+    triesHashes += lanes;
+    meter->add(thread_id, version, lanes);
+
+    for (size_t k = 0; k < lanes; k++) {
+      // fixed width compare, almost every hash stops here
+      if (!hashMeetsTarget(&batchOut[k * HASH_LEN], job->targetWords)) {
+        continue;
+      }
+      uint64_t lane_nonce = nonce + k;
+      memcpy(&work->buf[32], &lane_nonce, 8);
+      memcpy(work->output, &batchOut[k * HASH_LEN], HASH_LEN);
+      // rare candidate, verify with gmp before submitting
+      mpz_fromBytesNoInit(work->output, HASH_LEN, mpz_result);
+      if (mpz_cmp(mpz_result, job->target) > 0) {
+        logger->warn("thread {} target compare disagrees with gmp", thread_id);
+        continue;
+      }
+#ifdef DEBUG
+      printf("thread %d mining version %c (input=%s)\n", thread_id,
+             version, job->inputStr);
+      printf("input from thread %d: ", thread_id);
+      print_hex(work->buf, 40);
+      printf("\n");
+      printf("output from thread %d: ", thread_id);
+      print_hex(work->output, 32);
+      printf("\n");
+      printf("nonce from thread %d:", thread_id);
+      print_hex(&work->buf[32], 8);
+      printf("\n");
+      printf("diff target from thread %d:", thread_id);
+      std::cout << job->difficulty << std::endl;
+#endif
+      // hand it to the submit thread and keep hashing, blocks go first
+      Share *share = new Share;
+      memcpy(&share->nonce, &work->buf[32], 8);
+      strcpy(share->inputStr, job->inputStr);
+      share->pool = job->pool;
+      share->epoch = work->epoch;
+      share->thread_id = thread_id;
+      share->block = solomining ||
+                     hashMeetsTarget(&batchOut[k * HASH_LEN], job->blockWords);
+      share->foundAt = std::chrono::steady_clock::now();
+      (share->block ? foundBlocks : foundShares)++;
+      logger->info("thread {} found new {}", thread_id,
+                   share->block ? "block" : "share");
+      submitQueue.push(share);
+      if (solomining) {
+        // ask for the next template while the block is being submitted,
+        // and keep hashing until it's here
+        pools[job->pool]->wake();
+        logger->info("found a block, fetching the next template");
+      }
     }
   }
+  mpz_clear(mpz_result);
+  delete work;
   // std::this_thread::sleep_for(std::chrono::milliseconds(60));
 
   // if invalid diff, increase nonce
@@ -0,0 +1,57 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "nonce.hpp"
+
+NonceAllocator::NonceAllocator(uint16_t prefix, uint8_t threads)
+    : rigPrefix(prefix),
+      nextSpare(static_cast<unsigned>(threads) + 1),
+      usedBy(new std::atomic<uint64_t>[NONCE_SLOTS]) {
+  for (int i = 0; i < NONCE_SLOTS; i++) {
+    usedBy[i] = 0;
+  }
+}
+
+NonceRange NonceAllocator::range(uint8_t slot) const {
+  NonceRange r;
+  r.start = static_cast<uint64_t>(rigPrefix) << NONCE_PREFIX_SHIFT |
+            static_cast<uint64_t>(slot) << NONCE_SLOT_SHIFT;
+  r.next = r.start;
+  r.end = r.start + NONCE_RANGE_SIZE;
+  return r;
+}
+
+NonceRange NonceAllocator::assign(uint8_t thread_id) {
+  usedBy[thread_id] = 0;
+  return range(thread_id);
+}
+
+NonceRange NonceAllocator::extend(uint8_t thread_id) {
+  unsigned slot = nextSpare.fetch_add(1);
+  if (slot >= NONCE_SLOTS) {
+    return range(thread_id);
+  }
+  return range(static_cast<uint8_t>(slot));
+}
+
+void NonceAllocator::record(uint8_t thread_id, uint64_t used) {
+  usedBy[thread_id] = used;
+}
+
+uint64_t NonceAllocator::used(uint8_t thread_id) const {
+  return usedBy[thread_id];
+}
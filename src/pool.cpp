@@ -0,0 +1,254 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pool.hpp"
+
+#include <stdlib.h>   // for strtol
+#include <string.h>   // for strlen, strncmp
+#include <strings.h>  // for strncasecmp
+
+#include <algorithm>  // for min, max
+#include <sstream>    // for stringstream
+#include <thread>     // for sleep_for
+
+namespace {
+
+// "name=N" with N in [min, 1000000], into *value
+bool poolOption(const std::string &word, const char *name, int min,
+                int *value) {
+  size_t n = strlen(name);
+  if (word.size() <= n + 1 || word.compare(0, n, name) != 0 ||
+      word[n] != '=') {
+    return false;
+  }
+  char *end = nullptr;
+  long v = strtol(word.c_str() + n + 1, &end, 10);
+  if (*end != 0 || v < min || v > 1000000) {
+    return false;
+  }
+  *value = static_cast<int>(v);
+  return true;
+}
+
+}  // namespace
+
+bool parsePoolSpec(const std::string &spec, PoolSpec *pool) {
+  std::stringstream ss(spec);
+  pool->priority = 0;
+  pool->weight = 1;
+  if (!(ss >> pool->url)) {
+    return false;
+  }
+  for (std::string word; ss >> word;) {
+    if (!poolOption(word, "priority", 0, &pool->priority) &&
+        !poolOption(word, "weight", 1, &pool->weight)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Pool::Pool(const PoolSpec &poolSpec, int poolIndex)
+    : spec(poolSpec),
+      index(poolIndex),
+      getworkcurl(nullptr),
+      submitcurl(nullptr),
+      stratum(nullptr),
+      longPolling(false),
+      accepted(0),
+      rejected(0),
+      hasJob(false),
+      rtt(0),
+      errors(0),
+      down(false),
+      woken(false) {
+  if (spec.url.compare(0, strlen(STRATUM_SCHEME), STRATUM_SCHEME) == 0) {
+    stratum = new StratumClient();
+  }
+}
+
+Pool::~Pool() {
+  delete stratum;
+  if (getworkcurl != nullptr) {
+    curl_easy_cleanup(getworkcurl);
+  }
+  if (submitcurl != nullptr) {
+    curl_easy_cleanup(submitcurl);
+  }
+}
+
+void Pool::answered(double ms) {
+  std::lock_guard<std::mutex> lock(mu);
+  if (ms >= 0) {
+    rtt = rtt == 0 ? ms : 0.8 * rtt + 0.2 * ms;
+  }
+  errors *= 0.9;
+  down = false;
+}
+
+void Pool::failed() {
+  std::lock_guard<std::mutex> lock(mu);
+  errors = 0.9 * errors + 0.1;
+  down = true;
+}
+
+bool Pool::up() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return !down;
+}
+
+double Pool::latency() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return rtt;
+}
+
+double Pool::errorRate() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return errors;
+}
+
+double Pool::score() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return (1 - errors) / (1 + rtt / POOL_RTT_REF_MS);
+}
+
+void Pool::wake() {
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    woken = true;
+    chaseEnd = std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(POOL_CHASE_MAX_MS);
+  }
+  wakecv.notify_all();
+}
+
+void Pool::sleep(int ms) {
+  std::unique_lock<std::mutex> lock(mu);
+  wakecv.wait_for(lock, std::chrono::milliseconds(ms), [&] { return woken; });
+  woken = false;
+}
+
+bool Pool::chasing() const {
+  std::lock_guard<std::mutex> lock(mu);
+  return std::chrono::steady_clock::now() < chaseEnd;
+}
+
+void Pool::newJob() {
+  std::lock_guard<std::mutex> lock(mu);
+  chaseEnd = std::chrono::steady_clock::time_point();
+}
+
+// Long polling delivers new work as soon as the pool has it, so polls are
+// just a safety net then. Otherwise poll every few round trips: often on a
+// close pool, never flooding a far one. Right after a solo block it's all
+// about the next template, poll until it's out.
+int Pool::pollInterval() const {
+  if (chasing()) {
+    return POOL_CHASE_MS;
+  }
+  if (longPolling) {
+    return LONGPOLL_POLL_MS;
+  }
+  int ms = static_cast<int>(latency() * POLL_RTT_FACTOR);
+  return std::min(std::max(ms, POLL_MIN_MS), POLL_MAX_MS);
+}
+
+bool Pool::poll(const std::function<bool()> &fetch) {
+  bool ok = fetch();
+  sleep(ok ? pollInterval() : POLL_RETRY_MS);
+  return ok;
+}
+
+void Pool::longPoll(const std::function<bool()> &fetch, int backoffMs) {
+  int failures = 0;
+  while (failures < LONGPOLL_FAILURES) {
+    if (fetch()) {
+      failures = 0;
+      continue;
+    }
+    failures++;
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(backoffMs * failures));
+  }
+  longPolling = false;
+}
+
+std::string resolveUrl(const std::string &base, const std::string &ref) {
+  if (ref.find("://") != std::string::npos) {
+    return ref;
+  }
+  size_t scheme = base.find("://");
+  size_t path = base.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+  std::string host = base.substr(0, path);
+  return ref.empty() || ref[0] != '/' ? host + "/" + ref : host + ref;
+}
+
+std::size_t longPollHeader(const char *in, std::size_t size, std::size_t num,
+                           std::string *longPoll) {
+  const std::size_t totalBytes(size * num);
+  const char name[] = "x-long-polling:";
+  const std::size_t nameLen = sizeof(name) - 1;
+  if (totalBytes > nameLen && strncasecmp(in, name, nameLen) == 0) {
+    std::string value(in + nameLen, totalBytes - nameLen);
+    size_t first = value.find_first_not_of(" \t");
+    size_t last = value.find_last_not_of(" \t\r\n");
+    *longPoll = first == std::string::npos
+                    ? ""
+                    : value.substr(first, last - first + 1);
+  }
+  return totalBytes;
+}
+
+int choosePool(const std::vector<PoolChoice> &pools, int active, bool split,
+               bool rotate) {
+  const int n = static_cast<int>(pools.size());
+  int group = -1;  // lowest priority with a ready pool
+  for (const PoolChoice &p : pools) {
+    if (p.ready && (group < 0 || p.priority < group)) {
+      group = p.priority;
+    }
+  }
+  if (group < 0) {
+    return -1;
+  }
+  auto inGroup = [&](int i) {
+    return i >= 0 && i < n && pools[i].ready && pools[i].priority == group;
+  };
+  if (split) {
+    if (inGroup(active) && !rotate) {
+      return active;
+    }
+    // round robin, from the one after `active`
+    for (int k = 1; k <= n; k++) {
+      int i = (active + k + n) % n;
+      if (inGroup(i)) {
+        return i;
+      }
+    }
+  }
+  int top = -1;
+  for (int i = 0; i < n; i++) {
+    if (inGroup(i) && (top < 0 || pools[i].score > pools[top].score)) {
+      top = i;
+    }
+  }
+  if (inGroup(active) &&
+      pools[top].score <= POOL_SWITCH_MARGIN * pools[active].score) {
+    return active;
+  }
+  return top;
+}
@@ -0,0 +1,264 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "stratum.hpp"
+
+#include <jsoncpp/json/reader.h>  // for CharReaderBuilder
+#include <jsoncpp/json/writer.h>  // for StreamWriterBuilder
+#include <netdb.h>                // for getaddrinfo, freeaddrinfo
+#include <netinet/in.h>           // for IPPROTO_TCP
+#include <netinet/tcp.h>          // for TCP_NODELAY
+#include <poll.h>                 // for poll
+#include <sys/socket.h>           // for socket, connect, send, MSG_NOSIGNAL
+#include <unistd.h>               // for close, read
+
+#include <cerrno>  // for errno, EINTR
+#include <chrono>  // for milliseconds
+#include <cstdio>  // for snprintf
+#include <memory>  // for unique_ptr
+
+#define STRATUM_SUBSCRIBE_ID (1)
+// longest line a pool may send; a notify is a few hundred bytes, so a pool
+// going past this without a newline is broken or hostile
+#define STRATUM_LINE_MAX (64 * 1024)
+
+StratumClient::StratumClient()
+    : fd(-1), up(false), nextId(STRATUM_SUBSCRIBE_ID + 1) {}
+
+StratumClient::~StratumClient() { disconnect(); }
+
+bool StratumClient::parseUrl(const std::string &url, std::string *host,
+                             std::string *port) {
+  const std::string scheme = STRATUM_SCHEME;
+  if (url.compare(0, scheme.size(), scheme) != 0) {
+    return false;
+  }
+  std::string hostport = url.substr(scheme.size());
+  hostport = hostport.substr(0, hostport.find('/'));
+  size_t colon = hostport.rfind(':');
+  if (colon == std::string::npos || colon == 0 ||
+      colon + 1 == hostport.size()) {
+    return false;
+  }
+  *host = hostport.substr(0, colon);
+  *port = hostport.substr(colon + 1);
+  return true;
+}
+
+bool StratumClient::connect(const std::string &url, const std::string &agent) {
+  disconnect();
+  std::string host, port;
+  if (!parseUrl(url, &host, &port)) {
+    return false;
+  }
+  addrinfo hints = addrinfo();
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addrs = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+    return false;
+  }
+  int s = -1;
+  for (addrinfo *a = addrs; a != nullptr; a = a->ai_next) {
+    s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (s < 0) {
+      continue;
+    }
+    if (::connect(s, a->ai_addr, a->ai_addrlen) == 0) {
+      break;
+    }
+    close(s);
+    s = -1;
+  }
+  freeaddrinfo(addrs);
+  if (s < 0) {
+    return false;
+  }
+  // shares are tiny, don't let Nagle sit on them
+  int one = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  {
+    std::lock_guard<std::mutex> lock(writemu);
+    fd = s;
+  }
+  inbuf.clear();
+  lastJob = Json::Value();
+  shareTarget.clear();
+  up = true;
+  Json::Value params(Json::arrayValue);
+  params.append(agent);
+  Json::Value req;
+  req["id"] = STRATUM_SUBSCRIBE_ID;
+  req["method"] = "mining.subscribe";
+  req["params"] = params;
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "";
+  return send(Json::writeString(writer, req));
+}
+
+void StratumClient::disconnect() {
+  {
+    std::lock_guard<std::mutex> lock(writemu);
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  lost();
+}
+
+// wake every submit still waiting, its answer is not coming
+void StratumClient::lost() {
+  {
+    std::lock_guard<std::mutex> lock(resultmu);
+    up = false;
+  }
+  resultcv.notify_all();
+}
+
+bool StratumClient::send(const std::string &line) {
+  std::string out = line + "\n";
+  std::lock_guard<std::mutex> lock(writemu);
+  if (fd < 0) {
+    return false;
+  }
+  size_t sent = 0;
+  while (sent < out.size()) {
+    ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+// one line from the pool: a job goes to `params` (true), an answer to a
+// submit goes to whoever is waiting on it. mining.set_target (vardiff)
+// overrides the target of this job and the ones after it, so the job goes
+// out again with the new target.
+bool StratumClient::handle(const std::string &line, Json::Value *params) {
+  Json::Value msg;
+  Json::CharReaderBuilder builder;
+  JSONCPP_STRING err;
+  const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  if (!reader->parse(line.data(), line.data() + line.size(), &msg, &err) ||
+      !msg.isObject()) {
+    return false;
+  }
+  if (msg["method"].isString()) {
+    const std::string method = msg["method"].asString();
+    const Json::Value &p = msg["params"];
+    if (method == "mining.set_target" && p.isArray() && p.size() == 1 &&
+        p[0].isString()) {
+      shareTarget = p[0].asString();
+      if (lastJob.isNull()) {
+        return false;
+      }
+      lastJob[2] = shareTarget;
+      *params = lastJob;
+      return true;
+    }
+    if (method == "mining.notify" && p.isArray()) {
+      lastJob = p;
+      if (!shareTarget.empty() && lastJob.size() > 2) {
+        lastJob[2] = shareTarget;
+      }
+      *params = lastJob;
+      return true;
+    }
+    return false;
+  }
+  if (!msg["id"].isInt()) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(resultmu);
+    auto it = results.find(msg["id"].asInt());
+    if (it == results.end()) {
+      return false;  // subscribe, or a submit that gave up waiting
+    }
+    it->second = msg["result"].isBool() && msg["result"].asBool() ? 1 : 0;
+  }
+  resultcv.notify_all();
+  return false;
+}
+
+bool StratumClient::nextJob(Json::Value *params, int ms) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  char buf[4096];
+  while (up) {
+    size_t eol;
+    while ((eol = inbuf.find('\n')) != std::string::npos) {
+      std::string line = inbuf.substr(0, eol);
+      inbuf.erase(0, eol + 1);
+      if (handle(line, params)) {
+        return true;
+      }
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now())
+                    .count();
+    if (left <= 0) {
+      return false;
+    }
+    if (inbuf.size() > STRATUM_LINE_MAX) {
+      disconnect();
+      return false;
+    }
+    pollfd p = {fd, POLLIN, 0};
+    int ready = poll(&p, 1, static_cast<int>(left));
+    if (ready == 0) {
+      return false;
+    }
+    ssize_t n = ready < 0 ? -1 : read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;  // a signal, not the pool: poll again until the deadline
+    }
+    if (n <= 0) {
+      disconnect();
+      return false;
+    }
+    inbuf.append(buf, n);
+  }
+  return false;
+}
+
+SubmitResult StratumClient::submit(const char *nonceHex, const char *inputStr,
+                                   int ms) {
+  int id = nextId++;
+  char line[256];
+  snprintf(line, sizeof(line),
+           "{\"id\":%d,\"method\":\"mining.submit\",\"params\":"
+           "[\"0x%s\",\"%s\",\"0x%064d\"]}",
+           id, nonceHex, inputStr, 0);
+  std::unique_lock<std::mutex> lock(resultmu);
+  results[id] = -1;
+  lock.unlock();
+  bool sent = send(line);
+  lock.lock();
+  if (sent) {
+    resultcv.wait_for(lock, std::chrono::milliseconds(ms),
+                      [&] { return results[id] != -1 || !up; });
+  }
+  int answer = results[id];
+  results.erase(id);
+  if (answer == -1) {
+    return SUBMIT_FAILED;
+  }
+  return answer == 1 ? SUBMIT_ACCEPTED : SUBMIT_REJECTED;
+}
@@ -0,0 +1,110 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "submit.hpp"
+
+#include <chrono>            // for milliseconds
+#include <initializer_list>  // for initializer_list
+
+// Dmitry Vyukov's intrusive MPSC node queue: push is one exchange, and the
+// stub node keeps the list from ever being empty.
+
+ShareQueue::ShareQueue() : isClosed(false) {
+  for (Lane *lane : {&blocks, &shares}) {
+    lane->head = &lane->stub;
+    lane->tail = &lane->stub;
+    lane->stub.next = nullptr;
+  }
+}
+
+ShareQueue::~ShareQueue() {
+  while (Share *s = pop()) {
+    delete s;
+  }
+}
+
+void ShareQueue::link(Lane *lane, Share *share) {
+  share->next.store(nullptr, std::memory_order_relaxed);
+  Share *prev = lane->head.exchange(share, std::memory_order_acq_rel);
+  prev->next.store(share, std::memory_order_release);
+}
+
+void ShareQueue::push(Share *share) {
+  link(share->block ? &blocks : &shares, share);
+  // wake the submit thread, the lock makes sure it can't miss this between
+  // finding the queue empty and going to sleep
+  { std::lock_guard<std::mutex> lock(waitmu); }
+  waitcv.notify_one();
+}
+
+Share *ShareQueue::pop() {
+  Share *s = pop(&blocks);
+  return s != nullptr ? s : pop(&shares);
+}
+
+Share *ShareQueue::pop(Lane *lane) {
+  Share *t = lane->tail;
+  Share *next = t->next.load(std::memory_order_acquire);
+  if (t == &lane->stub) {
+    if (next == nullptr) {
+      return nullptr;
+    }
+    lane->tail = next;
+    t = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next != nullptr) {
+    lane->tail = next;
+    return t;
+  }
+  if (t != lane->head.load(std::memory_order_acquire)) {
+    // a push is half done, its share shows up on the next pop
+    return nullptr;
+  }
+  // t is the only share left, put the stub behind it so it can go
+  link(lane, &lane->stub);
+  next = t->next.load(std::memory_order_acquire);
+  if (next != nullptr) {
+    lane->tail = next;
+    return t;
+  }
+  return nullptr;
+}
+
+bool ShareQueue::empty(Lane *lane) {
+  return lane->tail == &lane->stub &&
+         lane->head.load(std::memory_order_acquire) == &lane->stub;
+}
+
+Share *ShareQueue::wait(int ms) {
+  Share *s = pop();
+  if (s != nullptr || closed()) {
+    return s;
+  }
+  std::unique_lock<std::mutex> lock(waitmu);
+  waitcv.wait_for(lock, std::chrono::milliseconds(ms), [&] {
+    return closed() || !empty(&blocks) || !empty(&shares);
+  });
+  lock.unlock();
+  return pop();
+}
+
+void ShareQueue::close() {
+  isClosed = true;
+  { std::lock_guard<std::mutex> lock(waitmu); }
+  waitcv.notify_all();
+}
@@ -0,0 +1,95 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "target.hpp"
+
+#include "aqua.hpp"  // for decodeHex, targetToWords, mpzToString
+
+mpz_srcptr mpz_maxBest() {
+  // built on first use and never freed, so it outlives every thread that
+  // might still be using it at exit
+  static mpz_srcptr pow256 = []() -> mpz_ptr {
+    mpz_ptr n = new __mpz_struct;
+    mpz_init(n);
+    mpz_setbit(n, 256);
+    return n;
+  }();
+  return pow256;
+}
+
+void computeTarget(mpz_srcptr mpz_difficulty, mpz_ptr mpz_target) {
+  if (mpz_sgn(mpz_difficulty) == 0) {
+    mpz_set(mpz_target, mpz_maxBest());
+    return;
+  }
+  mpz_div(mpz_target, mpz_maxBest(), mpz_difficulty);
+}
+
+void computeDifficulty(mpz_srcptr mpz_target, mpz_ptr mpz_difficulty) {
+  computeTarget(mpz_target, mpz_difficulty);  // the same division
+}
+
+JobTargets::JobTargets() {
+  mpz_init(minShareTarget);
+  mpz_init(netDifficulty);
+  mpz_init(blockTarget);
+  mpz_init(scratch);
+}
+
+JobTargets::~JobTargets() {
+  mpz_clear(minShareTarget);
+  mpz_clear(netDifficulty);
+  mpz_clear(blockTarget);
+  mpz_clear(scratch);
+}
+
+void JobTargets::setMinShareDifficulty(unsigned long long difficulty) {
+  if (difficulty == 0) {
+    mpz_set_ui(minShareTarget, 0);
+    return;
+  }
+  mpz_import(scratch, 1, 1, sizeof(difficulty), 0, 0, &difficulty);
+  computeTarget(scratch, minShareTarget);
+}
+
+void JobTargets::compute(const char *target, const char *difficulty,
+                         mpz_ptr shareTarget, uint64_t shareWords[4],
+                         uint64_t blockWords[4],
+                         std::string *shareDifficulty) {
+  // a block needs both targets. Pools that send the share difficulty
+  // twice (and solo nodes) make every share a block.
+  decodeHex(target, shareTarget);
+  decodeHex(difficulty, netDifficulty);
+  mpz_set(blockTarget, shareTarget);
+  if (mpz_sgn(netDifficulty) > 0) {
+    computeTarget(netDifficulty, scratch);
+    if (mpz_cmp(scratch, blockTarget) < 0) {
+      mpz_set(blockTarget, scratch);
+    }
+  }
+  // --share-diff: keep easier shares to ourselves, but never blocks
+  if (mpz_sgn(minShareTarget) > 0 &&
+      mpz_cmp(minShareTarget, shareTarget) < 0) {
+    mpz_set(shareTarget, minShareTarget);
+    if (mpz_cmp(shareTarget, blockTarget) < 0) {
+      mpz_set(shareTarget, blockTarget);
+    }
+  }
+  targetToWords(shareTarget, shareWords);
+  targetToWords(blockTarget, blockWords);
+  computeDifficulty(shareTarget, scratch);
+  *shareDifficulty = mpzToString(scratch);
+}
@@ -15,12 +15,13 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <aquahash.h>        // for FLAG_clear_internal_memory
 #include <gmp.h>             // for mpz_init
 #include <spdlog/fmt/fmt.h>  // for format_to
 #include <spdlog/logger.h>   // for logger::set_level
 #include <stdint.h>          // for uint8_t
 #include <stdio.h>           // for printf
-#include <stdlib.h>          // for malloc
+#include <stdlib.h>          // for malloc, exit
 
 #include <algorithm>  // for max
 #include <memory>     // for shared_ptr, __share...
@@ -28,7 +29,10 @@
 #include <utility>    // for move
 #include <vector>     // for vector
 
+#include "arena.hpp"     // for HashArena
+#include "engine.hpp"    // for aquahash_batch_selftest
 #include "miner.hpp"
+#include "topology.hpp"  // for cpuTopology
 #include "spdlog/common.h"                        // for debug
 #include "spdlog/logger.h"                        // for logger
 #include "spdlog/sinks/ansicolor_sink-inl.h"      // for ansicolor_sink::pri...
@@ -41,13 +45,16 @@
 #endif
 
 WorkPacket::WorkPacket() {
-  this->input =
-      static_cast<uint8_t *>(malloc(HASH_INPUT_LEN * sizeof(uint8_t)));
   this->output = static_cast<uint8_t *>(malloc(HASH_LEN * sizeof(uint8_t)));
   this->nonce = 0;
   this->noncebuf = static_cast<uint8_t *>(malloc(8 * sizeof(uint8_t)));
-  mpz_init(this->difficulty);
-  mpz_init(this->target);
+  memset(this->buf, 0, sizeof(this->buf));
+  this->epoch = 0;
+}
+
+WorkPacket::~WorkPacket() {
+  free(this->output);
+  free(this->noncebuf);
 }
 
 void Miner::start(void) {
@@ -64,7 +71,54 @@ void Miner::start(void) {
     num_cpus = numThreads;
   }
 
+  // argon2 wipes its block memory after every hash by default. Nothing
+  // secret is hashed here, and the arenas are reused, so skip the wipe.
+  FLAG_clear_internal_memory = 0;
+
+  // batched hashing engine, checked against libaquahash before use
+  useEngine = aquahash_batch_selftest();
+  if (useEngine) {
+    hashLanes = aquahash_batch_width() * batchWidths;
+    logger->info("aquahash kernel: {} ({} nonces per batch, cpu has: {})",
+                 aquahash_batch_isa(), hashLanes, aquahash_batch_kernels());
+  } else {
+    hashLanes = 1;
+    logger->error(
+        "aquahash {} engine failed its self test, hashing with libaquahash",
+        aquahash_batch_isa());
+  }
+
+  // what huge pages, if asked for, turn out to be on this system
+  if (arena_hugepages()) {
+    HashArena probe;
+    if (probe.reserve(1)) {
+      logger->info("hashing memory: {} pages", arena_pages_name(probe.pages()));
+    }
+  }
+
+  std::vector<CpuInfo> cpus = cpuTopology();
+  logger->info("cpu topology: {}", describeTopology(cpus));
+  if (!pinCpus.empty() && numThreads > pinCpus.size()) {
+    logger->warn("{} threads share {} pinned cpus", numThreads,
+                 pinCpus.size());
+  }
+
+  nonces = new NonceAllocator(rigPrefix, numThreads);
+  logger->info("nonce prefix {:04x}, {} bit range per thread",
+               nonces->prefix(), NONCE_SLOT_SHIFT);
+  switchClock = new WorkSwitchClock(numThreads, &switchLatency);
+  meter = new HashrateMeter(numThreads);
+  if (!metricsListen.empty()) {
+    if (!metricsServer.start(metricsListen, [this] { return metrics(); })) {
+      logger->error("can't serve metrics on '{}'", metricsListen);
+      exit(111);
+    }
+    logger->info("metrics on port {}: /metrics and /metrics.json",
+                 metricsServer.port());
+  }
+
   std::thread gwt(&Miner::getworkThread, this, "getwork()");
+  std::thread submitter(&Miner::submitThread, this);
   // start threads
   logger->info("starting {} threads..", numThreads);
   std::vector<std::thread *> threads;
@@ -83,5 +137,8 @@ void Miner::start(void) {
     logger->info("miner thread {} ended", i + 1);
     i++;
   }
+  // send what is left, then stop
+  submitQueue.close();
+  submitter.join();
   logger->info("all threads finished");
 }
@@ -0,0 +1,207 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "topology.hpp"
+
+#include <pthread.h>  // for pthread_setaffinity_np
+#include <sched.h>    // for sched_getaffinity, CPU_COUNT
+
+#include <algorithm>  // for sort, stable_sort
+#include <cstdlib>    // for strtol
+#include <fstream>    // for ifstream
+#include <map>        // for map
+#include <set>        // for set
+#include <sstream>    // for stringstream
+#include <thread>     // for hardware_concurrency
+#include <utility>    // for pair
+
+#define SYS_CPU "/sys/devices/system/cpu/cpu"
+#define SYS_NODE "/sys/devices/system/node"
+
+namespace {
+
+// one number from a /sys file, `fallback` if it can't be read
+int readSysInt(const std::string &path, int fallback) {
+  std::ifstream in(path);
+  int v;
+  return in >> v ? v : fallback;
+}
+
+// which NUMA node each cpu is on, from the nodes' cpulists
+std::map<int, int> cpuNodes() {
+  std::map<int, int> nodes;
+  std::ifstream online(SYS_NODE "/online");
+  std::string list;
+  std::vector<int> nodeNumbers;
+  if (!std::getline(online, list) || !parseCpuList(list, &nodeNumbers)) {
+    return nodes;  // no NUMA
+  }
+  for (int node : nodeNumbers) {
+    std::ifstream in(SYS_NODE "/node" + std::to_string(node) + "/cpulist");
+    std::vector<int> cpus;
+    if (std::getline(in, list) && parseCpuList(list, &cpus)) {
+      for (int cpu : cpus) {
+        nodes[cpu] = node;
+      }
+    }
+  }
+  return nodes;
+}
+
+}  // namespace
+
+int onlineCpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+    return CPU_COUNT(&set);
+  }
+  int n = static_cast<int>(std::thread::hardware_concurrency());
+  return n > 0 ? n : 1;
+}
+
+std::vector<CpuInfo> cpuTopology() {
+  std::vector<CpuInfo> cpus;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    for (int i = 0; i < onlineCpus(); i++) {
+      CPU_SET(i, &allowed);
+    }
+  }
+  std::map<int, int> nodes = cpuNodes();
+  std::map<std::pair<int, int>, int> siblings;  // (package, core): seen
+  for (int i = 0; i < CPU_SETSIZE; i++) {
+    if (!CPU_ISSET(i, &allowed)) {
+      continue;
+    }
+    const std::string dir = SYS_CPU + std::to_string(i) + "/topology/";
+    CpuInfo c;
+    c.cpu = i;
+    c.core = readSysInt(dir + "core_id", i);
+    c.package = readSysInt(dir + "physical_package_id", 0);
+    c.node = nodes.count(i) ? nodes[i] : 0;
+    c.sibling = siblings[std::make_pair(c.package, c.core)]++;
+    cpus.push_back(c);
+  }
+  return cpus;
+}
+
+std::string describeTopology(const std::vector<CpuInfo> &cpus) {
+  std::set<int> nodes, packages;
+  std::set<std::pair<int, int>> cores;
+  for (const CpuInfo &c : cpus) {
+    nodes.insert(c.node);
+    packages.insert(c.package);
+    cores.insert(std::make_pair(c.package, c.core));
+  }
+  std::stringstream ss;
+  ss << nodes.size() << (nodes.size() == 1 ? " node, " : " nodes, ")
+     << packages.size() << (packages.size() == 1 ? " package, " : " packages, ")
+     << cores.size() << (cores.size() == 1 ? " core, " : " cores, ")
+     << cpus.size() << (cpus.size() == 1 ? " cpu" : " cpus");
+  return ss.str();
+}
+
+bool pinPolicyKnown(const std::string &policy) {
+  return policy == PIN_NONE || policy == PIN_COMPACT ||
+         policy == PIN_SCATTER || policy == PIN_CORES;
+}
+
+std::vector<int> pinOrder(const std::string &policy,
+                          const std::vector<CpuInfo> &cpus) {
+  std::vector<CpuInfo> order = cpus;
+  if (policy == PIN_COMPACT || policy == PIN_CORES) {
+    // node by node, core by core, siblings next to each other
+    std::sort(order.begin(), order.end(),
+              [](const CpuInfo &a, const CpuInfo &b) {
+                if (a.node != b.node) return a.node < b.node;
+                if (a.package != b.package) return a.package < b.package;
+                if (a.core != b.core) return a.core < b.core;
+                return a.sibling < b.sibling;
+              });
+    if (policy == PIN_CORES) {
+      order.erase(std::remove_if(order.begin(), order.end(),
+                                 [](const CpuInfo &c) { return c.sibling; }),
+                  order.end());
+    }
+  } else if (policy == PIN_SCATTER) {
+    // first siblings before second ones, and round robin over the NUMA
+    // nodes so each gets its share of the threads and memory bandwidth
+    std::map<std::pair<int, int>, int> rank;  // (node, sibling): next rank
+    std::vector<std::pair<std::pair<int, int>, CpuInfo>> keyed;
+    std::sort(order.begin(), order.end(),
+              [](const CpuInfo &a, const CpuInfo &b) {
+                if (a.package != b.package) return a.package < b.package;
+                return a.core != b.core ? a.core < b.core : a.cpu < b.cpu;
+              });
+    for (const CpuInfo &c : order) {
+      int r = rank[std::make_pair(c.node, c.sibling)]++;
+      keyed.push_back(std::make_pair(std::make_pair(c.sibling, r), c));
+    }
+    std::stable_sort(keyed.begin(), keyed.end(),
+                     [](const std::pair<std::pair<int, int>, CpuInfo> &a,
+                        const std::pair<std::pair<int, int>, CpuInfo> &b) {
+                       if (a.first != b.first) return a.first < b.first;
+                       return a.second.node < b.second.node;
+                     });
+    order.clear();
+    for (auto &k : keyed) {
+      order.push_back(k.second);
+    }
+  } else {
+    order.clear();
+  }
+  std::vector<int> cpuNumbers;
+  for (const CpuInfo &c : order) {
+    cpuNumbers.push_back(c.cpu);
+  }
+  return cpuNumbers;
+}
+
+bool parseCpuList(const std::string &list, std::vector<int> *out) {
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    char *end = nullptr;
+    long first = strtol(item.c_str(), &end, 10);
+    long last = first;
+    if (*end == '-') {
+      last = strtol(end + 1, &end, 10);
+    }
+    while (*end == ' ' || *end == '\n') {
+      end++;
+    }
+    if (item.empty() || *end != 0 || first < 0 || last < first ||
+        last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      out->push_back(static_cast<int>(cpu));
+    }
+  }
+  return !out->empty();
+}
+
+bool pinThread(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
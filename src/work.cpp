@@ -0,0 +1,116 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "work.hpp"
+
+#include <string.h>  // for memset
+
+#include <chrono>  // for steady_clock
+
+#include "metrics.hpp"  // for LatencyHistogram
+
+Work::Work() : version(0), pool(0), epoch(0) {
+  memset(input, 0, sizeof(input));
+  memset(inputStr, 0, sizeof(inputStr));
+  memset(targetWords, 0, sizeof(targetWords));
+  memset(blockWords, 0, sizeof(blockWords));
+  mpz_init(target);
+  difficulty = "0";
+}
+
+Work::~Work() { mpz_clear(target); }
+
+WorkChannel::WorkChannel() : seq(0) {}
+
+void WorkChannel::publish(const std::shared_ptr<Work> &work) {
+  uint64_t e = seq.load(std::memory_order_relaxed) + 1;
+  work->epoch = e;
+  // the work first, so a reader that sees the new epoch gets it
+  std::atomic_store(&current, std::shared_ptr<const Work>(work));
+  seq.store(e, std::memory_order_release);
+  // wake idle threads, the lock makes sure none misses it between its
+  // epoch check and going to sleep
+  { std::lock_guard<std::mutex> lock(waitmu); }
+  waitcv.notify_all();
+}
+
+std::shared_ptr<const Work> WorkChannel::read() const {
+  return std::atomic_load(&current);
+}
+
+bool WorkChannel::wait(uint64_t seen, int ms) const {
+  std::unique_lock<std::mutex> lock(waitmu);
+  return waitcv.wait_for(lock, std::chrono::milliseconds(ms),
+                         [&] { return epoch() != seen; });
+}
+
+namespace {
+long long nowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+WorkSwitchClock::WorkSwitchClock(uint8_t threads, LatencyHistogram *hist)
+    : numThreads(threads),
+      publishedEpoch(0),
+      publishedAt(0),
+      lastLatency(-1),
+      recordedEpoch(0),
+      threadSwitch(new Switch[threads + 1]),
+      histogram(hist) {
+  for (int i = 0; i <= threads; i++) {
+    threadSwitch[i].epoch = 0;
+    threadSwitch[i].at = 0;
+  }
+}
+
+void WorkSwitchClock::published(uint64_t epoch) {
+  publishedAt.store(nowMicros(), std::memory_order_relaxed);
+  publishedEpoch.store(epoch, std::memory_order_release);
+}
+
+void WorkSwitchClock::switched(uint8_t thread_id, uint64_t epoch) {
+  threadSwitch[thread_id].at.store(nowMicros(), std::memory_order_relaxed);
+  threadSwitch[thread_id].epoch.store(epoch, std::memory_order_release);
+  // the last thread to switch records how long it took
+  if (epoch != publishedEpoch.load(std::memory_order_acquire)) {
+    return;
+  }
+  long long start = publishedAt.load(std::memory_order_relaxed);
+  long long last = start;
+  for (int i = 1; i <= numThreads; i++) {
+    if (threadSwitch[i].epoch.load(std::memory_order_acquire) != epoch) {
+      return;
+    }
+    long long at = threadSwitch[i].at.load(std::memory_order_relaxed);
+    if (at > last) {
+      last = at;
+    }
+  }
+  // two threads can both see everyone switched, time it once
+  uint64_t recorded = recordedEpoch.load(std::memory_order_relaxed);
+  if (recorded == epoch ||
+      !recordedEpoch.compare_exchange_strong(recorded, epoch)) {
+    return;
+  }
+  lastLatency = last - start;
+  if (histogram != nullptr) {
+    histogram->observe((last - start) / 1000.0);
+  }
+}
@@ -0,0 +1,111 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <aquahash.h>  // for ARGON2_OK
+#include <stdint.h>    // for uint8_t, uint32_t, uint64_t
+#include <stdio.h>     // for printf
+#include <stdlib.h>    // for posix_memalign, free
+#include <string.h>    // for memcpy, memcmp
+
+#include <sstream>  // for istringstream
+#include <string>   // for string
+
+#include "aqua.hpp"    // for HASH_LEN, HASH_INPUT_LEN
+#include "arena.hpp"   // for ARENA_PAGE
+#include "engine.hpp"  // for aquahash_batch, aquahash_batch_select
+#include "tests.hpp"
+
+// miner.cpp, libaquahash's one hash at a time
+int aquahash_version(void *output, const void *input, uint32_t mem);
+
+namespace {
+
+// aquahash_batch and aquahash_batch_nonces at m_cost `mem` on the selected
+// kernel, every lane and one leftover, against libaquahash. Returns how many
+// hashes differ.
+unsigned long compare(uint32_t mem) {
+  const size_t n = AQUAHASH_MAX_LANES + 1;
+  uint8_t in[n * HASH_INPUT_LEN];
+  uint8_t nonceIn[n * HASH_INPUT_LEN];
+  uint8_t out[n * HASH_LEN];
+  uint8_t nonceOut[n * HASH_LEN];
+  uint8_t want[HASH_LEN];
+  for (size_t i = 0; i < sizeof(in); i++) {
+    in[i] = static_cast<uint8_t>(i * 37 + mem);
+  }
+  const uint64_t nonce = 0xfffffffaULL;  // carries into the high half
+  for (size_t i = 0; i < n; i++) {
+    uint64_t laneNonce = nonce + i;
+    memcpy(nonceIn + i * HASH_INPUT_LEN, in, 32);
+    memcpy(nonceIn + i * HASH_INPUT_LEN + 32, &laneNonce, 8);
+  }
+  void *memory = nullptr;
+  if (posix_memalign(&memory, ARENA_PAGE, aquahash_batch_memsize(mem)) != 0) {
+    return 2 * n;
+  }
+  aquahash_batch(out, in, n, mem, memory);
+  AquahashMidstate mid;
+  aquahash_midstate(&mid, in, mem);
+  aquahash_batch_nonces(nonceOut, mid, nonce, n, memory);
+  free(memory);
+  unsigned long wrong = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (ARGON2_OK != aquahash_version(want, in + i * HASH_INPUT_LEN, mem) ||
+        memcmp(want, out + i * HASH_LEN, HASH_LEN) != 0) {
+      wrong++;
+    }
+    if (ARGON2_OK !=
+            aquahash_version(want, nonceIn + i * HASH_INPUT_LEN, mem) ||
+        memcmp(want, nonceOut + i * HASH_LEN, HASH_LEN) != 0) {
+      wrong++;
+    }
+  }
+  return wrong;
+}
+
+}  // namespace
+
+// Every kernel this cpu runs must pass the selftest the miner runs before
+// using it (v2, v3 and v4), and match libaquahash at m_costs with no
+// specialised code: 600 KiB needs more than one block of data-independent
+// addresses per segment, the rest have odd segment lengths.
+unsigned long testEngine() {
+  const uint32_t mems[] = {8, 12, 100, 600};
+  unsigned long wrong = 0;
+  unsigned long kernels = 0;
+  std::string failed;
+  std::istringstream names(aquahash_batch_kernels());
+  std::string name;
+  while (names >> name) {
+    kernels++;
+    unsigned long before = wrong;
+    if (!aquahash_batch_select(name) || !aquahash_batch_selftest()) {
+      wrong++;
+    } else {
+      for (uint32_t mem : mems) {
+        wrong += compare(mem);
+      }
+    }
+    if (wrong != before) {
+      failed += " " + name;
+    }
+  }
+  aquahash_batch_select("auto");
+  printf("engine: %lu kernels against libaquahash, %lu wrong%s%s\n", kernels,
+         wrong, failed.empty() ? "" : ", failed:", failed.c_str());
+  return wrong;
+}
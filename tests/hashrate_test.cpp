@@ -0,0 +1,104 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <math.h>    // for exp, fabs
+#include <stdint.h>  // for uint8_t, uint64_t
+#include <stdio.h>   // for printf
+
+#include <algorithm>  // for max
+#include <atomic>     // for atomic
+#include <chrono>     // for steady_clock, milliseconds
+#include <thread>     // for thread
+#include <vector>     // for vector
+
+#include "hashrate.hpp"  // for HashrateMeter, HashRates
+#include "tests.hpp"
+
+// HashrateMeter's rates against counts of known rates on a made up clock,
+// and its counters timed from a thread per cpu against one shared atomic
+unsigned long testHashrateMeter() {
+  const int threads =
+      std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+  double rate[2];  // own counters, shared atomic
+  unsigned long wrong = 0;
+  auto off = [&](double got, double want) {
+    if (fabs(got - want) > 1e-6 * want) {
+      wrong++;
+    }
+  };
+
+  // thread k hashes 1000 * k per second for half an hour, then twice that
+  // for a minute. After a step the averages close (1 - e^(-t/window)) of
+  // the gap, sampling every second doesn't change that.
+  {
+    HashrateMeter meter(3);
+    std::chrono::steady_clock::time_point t;
+    meter.sample(t);
+    for (int s = 0; s < 30 * 60 + 60; s++) {
+      int scale = s < 30 * 60 ? 1 : 2;
+      for (int k = 1; k <= 3; k++) {
+        meter.add(static_cast<uint8_t>(k), k == 1 ? '2' : '4',
+                  1000 * k * scale);
+      }
+      t += std::chrono::milliseconds(HASHRATE_SAMPLE_MS);
+      meter.sample(t);
+    }
+    HashRates r = meter.total();
+    off(r.now, 12000);
+    off(r.m1, 12000 - 6000 * exp(-1.0));
+    off(r.m5, 12000 - 6000 * exp(-60.0 / 300));
+    off(r.m15, 12000 - 6000 * exp(-60.0 / 900));
+    off(meter.thread(2).now, 4000);
+    off(meter.version(0), 2000);
+    off(meter.version(2), 10000);
+    off(static_cast<double>(meter.hashes()), 6000.0 * 30 * 60 + 12000 * 60);
+  }
+
+  // every thread counting as fast as it can, into its own counter or into
+  // one shared atomic
+  const uint64_t n = 10000000;
+  HashrateMeter meter(static_cast<uint8_t>(threads));
+  std::atomic<uint64_t> shared(0);
+  for (int pass = 0; pass < 2; pass++) {
+    std::vector<std::thread> workers;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int k = 1; k <= threads; k++) {
+      workers.push_back(std::thread([&, k] {
+        for (uint64_t i = 0; i < n; i++) {
+          if (pass == 0) {
+            meter.add(static_cast<uint8_t>(k), '2', 1);
+          } else {
+            shared.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }));
+    }
+    for (auto &w : workers) {
+      w.join();
+    }
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - t1;
+    rate[pass] = n * threads / took.count();
+  }
+  if (meter.hashes() != n * threads || shared != n * threads) {
+    wrong++;
+  }
+  printf(
+      "hashrate counters: %d threads, own counter %4.1f M adds/sec, shared "
+      "atomic %4.1f M adds/sec, %lu rates off\n",
+      threads, rate[0] / 1e6, rate[1] / 1e6, wrong);
+  return wrong;
+}
@@ -0,0 +1,118 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdint.h>  // for uint8_t
+#include <stdio.h>   // for printf, snprintf
+#include <string.h>  // for memcmp
+
+#include <chrono>   // for high_resolution_clock
+#include <random>   // for mt19937_64
+#include <sstream>  // for istringstream
+#include <string>   // for string
+#include <vector>   // for vector
+
+#include "hexcodec.hpp"  // for hexEncode, hexDecode, hexSelect
+#include "tests.hpp"
+
+namespace {
+
+// keeps the timed decoding from being optimized away
+volatile unsigned long sink;
+
+// 32 byte headers to hex and back, n of them. Returns headers per second.
+double roundTrips(const std::vector<uint8_t> &headers, unsigned long n) {
+  size_t count = headers.size() / 32;
+  char hex[65];
+  uint8_t back[32];
+  unsigned long sum = 0;
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (unsigned long i = 0; i < n; i++) {
+    hexEncode(hex, &headers[(i % count) * 32], 32);
+    sum += hexDecode(back, hex, 64);
+    sum += back[i % 32];
+  }
+  std::chrono::duration<double> dur =
+      std::chrono::high_resolution_clock::now() - t1;
+  sink = sum;
+  return n / dur.count();
+}
+
+}  // namespace
+
+// Random byte strings through every codec this cpu runs, long enough for
+// every step of the widest one and its tail: the hex must match printf's,
+// decode back in either case, and a bad digit anywhere must be refused.
+// Times 32 byte header round trips on each codec.
+unsigned long testHexCodec() {
+  const unsigned long n = 100000;
+  // the digits' neighbours, and bytes that look like letters once 0x20 is
+  // or'ed in
+  static const char notHex[] = {'/', ':', '@', 'G', '`', 'g', 'x', ' ',
+                                '\0', '\x80', '\xc1', '\xe6', '\xff'};
+  std::mt19937_64 prng(n);
+  std::vector<uint8_t> headers(32 * 1024);
+  for (size_t i = 0; i < headers.size(); i++) {
+    headers[i] = static_cast<uint8_t>(prng());
+  }
+  unsigned long wrong = 0;
+  std::string rates;
+  std::istringstream names(hexCodecs());
+  std::string name;
+  while (names >> name) {
+    if (!hexSelect(name)) {
+      wrong++;
+      continue;
+    }
+    for (unsigned long t = 0; t < n; t++) {
+      size_t len = prng() % 100;
+      std::vector<uint8_t> in(len + 1), back(len + 1);
+      std::vector<char> want(2 * len + 1), got(2 * len + 1);
+      for (size_t i = 0; i < len; i++) {
+        in[i] = static_cast<uint8_t>(prng());
+        snprintf(&want[2 * i], 3, "%02x", in[i]);
+      }
+      hexEncode(&got[0], &in[0], len);
+      bool ok = memcmp(&got[0], &want[0], 2 * len + 1) == 0 &&
+                hexDecode(&back[0], &got[0], 2 * len) &&
+                memcmp(&back[0], &in[0], len) == 0;
+      // capitals decode the same
+      for (size_t i = 0; i < 2 * len; i++) {
+        if (got[i] >= 'a') {
+          got[i] = static_cast<char>(got[i] - 'a' + 'A');
+        }
+      }
+      ok = ok && hexDecode(&back[0], &got[0], 2 * len) &&
+           memcmp(&back[0], &in[0], len) == 0;
+      // one bad digit anywhere
+      if (len > 0) {
+        got[prng() % (2 * len)] = notHex[prng() % sizeof(notHex)];
+        ok = ok && !hexDecode(&back[0], &got[0], 2 * len);
+      }
+      if (!ok) {
+        wrong++;
+      }
+    }
+    char rate[64];
+    snprintf(rate, sizeof(rate), ", %s %4.1f M/sec", name.c_str(),
+             roundTrips(headers, n * 10) / 1e6);
+    rates += rate;
+  }
+  hexSelect("auto");
+  printf("hex codec: %lu round trips per codec, %lu wrong; 32 byte headers%s\n",
+         n, wrong, rates.c_str());
+  return wrong;
+}
@@ -0,0 +1,185 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <jsoncpp/json/reader.h>  // for CharReaderBuilder
+#include <stdio.h>                // for printf
+#include <string.h>               // for memcmp
+
+#include <chrono>  // for steady_clock
+#include <memory>  // for unique_ptr
+#include <random>  // for mt19937_64
+#include <string>  // for string
+#include <vector>  // for vector
+
+#include "jsonscan.hpp"  // for scanGetwork, scanSubmit, jobFromJson
+#include "tests.hpp"
+
+namespace {
+
+// the "result" member of a reply as jsoncpp reads it, the way the miner
+// parsed every reply before
+bool jsonResult(const char *buf, size_t len, Json::Value *result) {
+  Json::CharReaderBuilder builder;
+  const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  Json::Value root;
+  JSONCPP_STRING err;
+  if (!reader->parse(buf, buf + len, &root, &err) || !root.isObject()) {
+    return false;
+  }
+  *result = root["result"];
+  return true;
+}
+
+// a scanner took `buf`: does jsoncpp read the same?
+bool agrees(const char *buf, size_t len, const GetworkJob *job,
+            const bool *accepted) {
+  Json::Value result;
+  if (!jsonResult(buf, len, &result)) {
+    return false;
+  }
+  if (job != nullptr) {
+    GetworkJob want;
+    return jobFromJson(result, &want) && memcmp(&want, job, sizeof(want)) == 0;
+  }
+  return result.isBool() && result.asBool() == *accepted;
+}
+
+std::vector<std::string> getworkReplies() {
+  const std::string job =
+      "[\"0x" + std::string(32, 'a') + std::string(32, '7') + "\",\"0x" +
+      std::string(63, '0') + "4\",\"0x00000000" + std::string(56, 'f') +
+      "\",\"0x100000000\"";
+  std::vector<std::string> r;
+  r.push_back("{\"jsonrpc\":\"2.0\",\"id\":42,\"result\":" + job + "]}");
+  r.push_back("{\"result\":" + job + "],\"id\":42,\"jsonrpc\":\"2.0\"}\n");
+  r.push_back("{\n  \"id\" : 42,\n  \"jsonrpc\" : \"2.0\",\n  \"result\" : " +
+              job + " ]\n}\n");
+  r.push_back(
+      "{\"id\":\"a\\\"b\\u00e9\\ud83d\\ude00\",\"error\":null,"
+      "\"extra\":{\"a\":[1,-2.5e+3,0.5,true,false,null,{}],\"b\":[]},"
+      "\"result\":" +
+      job + ",\"0x5\",[1]]}");
+  return r;
+}
+
+std::vector<std::string> submitReplies() {
+  std::vector<std::string> r;
+  r.push_back("{\"jsonrpc\":\"2.0\",\"id\":42,\"result\":true}");
+  r.push_back("{\"id\":42,\"result\":false,\"jsonrpc\":\"2.0\"}\n");
+  return r;
+}
+
+// flip, drop, add, duplicate or cut bytes, biased to JSON syntax
+void mutate(std::mt19937_64 *prng, std::string *s) {
+  static const char syntax[] = "{}[]\",:\\ 0x9afeE-+.tnlu\n";
+  const size_t at = s->empty() ? 0 : (*prng)() % s->size();
+  const char ch = (*prng)() % 2 ? syntax[(*prng)() % (sizeof(syntax) - 1)]
+                                : static_cast<char>((*prng)());
+  switch ((*prng)() % 5) {
+    case 0:
+      if (!s->empty()) (*s)[at] = ch;
+      break;
+    case 1:
+      if (!s->empty()) s->erase(at, 1);
+      break;
+    case 2:
+      s->insert(at, 1, ch);
+      break;
+    case 3:
+      s->resize(at);
+      break;
+    default:
+      s->insert(at, s->substr((*prng)() % (s->size() + 1), (*prng)() % 16));
+      break;
+  }
+}
+
+}  // namespace
+
+// Fuzz the scanners with mutated pool replies, on buffers exactly the
+// reply's size, and time them against jsoncpp. Every reply a scanner takes
+// must read the same under jsoncpp, and every well formed one must be
+// taken.
+unsigned long testJsonScan() {
+  const unsigned long n = 100000;
+  unsigned long parsed = 0;
+  std::vector<std::string> getworks = getworkReplies();
+  std::vector<std::string> submits = submitReplies();
+  std::vector<std::string> seeds(getworks);
+  seeds.insert(seeds.end(), submits.begin(), submits.end());
+  unsigned long bad = 0;
+  GetworkJob job;
+  bool ok;
+  for (const std::string &s : getworks) {
+    if (!scanGetwork(s.data(), s.size(), &job) ||
+        !agrees(s.data(), s.size(), &job, nullptr)) {
+      bad++;
+    }
+  }
+  for (const std::string &s : submits) {
+    if (!scanSubmit(s.data(), s.size(), &ok) ||
+        !agrees(s.data(), s.size(), nullptr, &ok)) {
+      bad++;
+    }
+  }
+
+  std::mt19937_64 prng(n);
+  for (unsigned long i = 0; i < n; i++) {
+    std::string s = seeds[prng() % seeds.size()];
+    for (int m = 1 + prng() % 4; m > 0; m--) {
+      mutate(&prng, &s);
+    }
+    // exactly the reply's bytes, so reading past it is a real overrun
+    std::vector<char> buf(s.begin(), s.end());
+    if (scanGetwork(buf.data(), buf.size(), &job)) {
+      parsed++;
+      if (!agrees(buf.data(), buf.size(), &job, nullptr)) {
+        bad++;
+      }
+    }
+    if (scanSubmit(buf.data(), buf.size(), &ok) &&
+        !agrees(buf.data(), buf.size(), nullptr, &ok)) {
+      bad++;
+    }
+  }
+
+  // per poll cost, the scanner against jsoncpp as the miner used it
+  typedef std::chrono::steady_clock Clock;
+  const unsigned long rounds = n / 10 + 1;
+  auto t0 = Clock::now();
+  for (unsigned long i = 0; i < rounds; i++) {
+    const std::string &s = getworks[i % getworks.size()];
+    bad += scanGetwork(s.data(), s.size(), &job) ? 0 : 1;
+  }
+  auto t1 = Clock::now();
+  for (unsigned long i = 0; i < rounds; i++) {
+    const std::string &s = getworks[i % getworks.size()];
+    Json::Value result;
+    bad += jsonResult(s.data(), s.size(), &result) &&
+                   jobFromJson(result, &job)
+               ? 0
+               : 1;
+  }
+  auto t2 = Clock::now();
+  std::chrono::duration<double> scanTime = t1 - t0, jsonTime = t2 - t1;
+  printf(
+      "reply parser: %lu fuzzed replies (%lu still valid), %lu wrong; "
+      "scanner %4.4f M/sec, jsoncpp %4.4f M/sec\n",
+      n, parsed, bad, rounds / scanTime.count() / 1e6,
+      rounds / jsonTime.count() / 1e6);
+  return bad;
+}
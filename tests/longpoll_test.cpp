@@ -0,0 +1,127 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <curl/curl.h>  // for curl_easy_setopt, curl_easy_perform
+#include <stdio.h>      // for printf
+
+#include <atomic>  // for atomic
+#include <chrono>  // for steady_clock, duration
+#include <string>  // for string
+#include <thread>  // for thread, sleep_for
+
+#include "jsonscan.hpp"  // for GetworkJob, scanGetwork
+#include "pool.hpp"      // for Pool, resolveUrl, longPollHeader
+#include "stubpool.hpp"  // for StubPool
+#include "tests.hpp"
+
+#define GETWORK_BODY \
+  "{\"jsonrpc\":\"2.0\",\"method\":\"aqua_getWork\",\"params\":[],\"id\":42}"
+
+namespace {
+
+// what longPollHeader makes of one header line, starting from "old"
+std::string header(const std::string &line) {
+  std::string value = "old";
+  longPollHeader(line.data(), 1, line.size(), &value);
+  return value;
+}
+
+}  // namespace
+
+// The miner's long polling against the stub pool. The long poll url is
+// picked out of a getwork reply and resolved against the pool url.
+// Pool::longPoll then sees new work as soon as the stub has it (timed,
+// next to a plain getwork round trip), and when the pool goes away it
+// gives up and pollInterval goes back to polling.
+unsigned long testLongPoll() {
+  unsigned long wrong = 0;
+  wrong += header("X-Long-Polling: /lp\r\n") != "/lp";
+  wrong += header("x-long-polling:\t http://b/lp \r\n") != "http://b/lp";
+  wrong += header("X-Long-Polling:\r\n") != "";
+  wrong += header("Content-Type: application/json\r\n") != "old";
+  wrong += resolveUrl("http://a:1/rpc/x", "/lp") != "http://a:1/lp";
+  wrong += resolveUrl("http://a:1", "lp") != "http://a:1/lp";
+  wrong += resolveUrl("a:1/rpc", "/lp") != "a:1/lp";
+  wrong += resolveUrl("http://a:1/", "https://b/lp") != "https://b/lp";
+
+  StubPool stub;
+  if (!stub.start()) {
+    printf("long poll: can't start the stub pool\n");
+    return 1;
+  }
+  std::string body, advertised;
+  CURL *curl = testCurl(stub.url(), &body, nullptr);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, GETWORK_BODY);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, longPollHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &advertised);
+  auto t1 = std::chrono::steady_clock::now();
+  CURLcode res = curl_easy_perform(curl);
+  std::chrono::duration<double, std::milli> rtt =
+      std::chrono::steady_clock::now() - t1;
+  std::string url = resolveUrl(stub.url(), advertised);
+  if (res != CURLE_OK || url != stub.url() + "lp") {
+    printf("long poll: getwork failed or had no long poll url: %s, %s\n",
+           curl_easy_strerror(res), url.c_str());
+    curl_easy_cleanup(curl);
+    return 1;
+  }
+
+  // what poolThread does when the pool advertises long polling
+  PoolSpec spec = {stub.url(), 0, 1};
+  Pool pool(spec, 0);
+  pool.longPolling = true;
+  wrong += pool.pollInterval() != LONGPOLL_POLL_MS;
+  const std::string input = "0x" + std::string(63, '0') + "2";
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  std::atomic<bool> gotWork(false);
+  std::chrono::steady_clock::time_point seen;
+  auto fetch = [&] {
+    body.clear();
+    GetworkJob job;
+    bool ok = curl_easy_perform(curl) == CURLE_OK &&
+              scanGetwork(body.data(), body.size(), &job);
+    if (ok && !gotWork && input == job.input) {
+      seen = std::chrono::steady_clock::now();
+      gotWork = true;
+    }
+    return ok;
+  };
+  std::thread poller([&] { pool.longPoll(fetch, 10); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto published = std::chrono::steady_clock::now();
+  stub.setWork(input);
+  for (int i = 0; i < 500 && !gotWork; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // the pool goes away, long polling has to give up on it
+  stub.stop();
+  poller.join();
+  curl_easy_cleanup(curl);
+  std::chrono::duration<double, std::milli> latency = seen - published;
+  bool fellBack = !pool.longPolling && pool.pollInterval() == POLL_MIN_MS;
+  pool.answered(100);
+  fellBack = fellBack && pool.pollInterval() == 100 * POLL_RTT_FACTOR;
+  pool.answered(10000);
+  fellBack = fellBack && pool.pollInterval() == POLL_MAX_MS;
+  wrong += !gotWork + !fellBack;
+  printf(
+      "long poll: new work %s %4.4f ms after the pool had it (getwork round "
+      "trip %4.4f ms), %s to polling, %lu wrong\n",
+      gotWork ? "seen" : "NOT seen", latency.count(), rtt.count(),
+      fellBack ? "fell back" : "did NOT fall back", wrong);
+  return wrong;
+}
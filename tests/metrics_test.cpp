@@ -0,0 +1,86 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <curl/curl.h>            // for curl_easy_setopt, curl_easy_perform
+#include <jsoncpp/json/reader.h>  // for CharReaderBuilder
+#include <jsoncpp/json/value.h>   // for Value
+#include <stdio.h>                // for printf
+
+#include <chrono>  // for steady_clock, duration
+#include <memory>  // for unique_ptr
+#include <string>  // for string, to_string
+
+#include "hashrate.hpp"  // for HashRates
+#include "metrics.hpp"   // for LatencyHistogram, MetricsServer
+#include "tests.hpp"
+
+// Scrape the metrics endpoint like a monitoring system would, and check
+// the histogram buckets
+unsigned long testMetrics() {
+  LatencyHistogram h;
+  h.observe(0.5);    // first bucket
+  h.observe(3);      // 5ms
+  h.observe(60000);  // past the last one
+  LatencyHistogram::Snapshot hs = h.snapshot();
+  bool bucketsOk = hs.count == 3 && hs.buckets[0] == 1 &&
+                   hs.buckets[2] == 1 && hs.buckets[METRICS_NUM_BUCKETS] == 1;
+
+  // a miner that has just started
+  MetricsSnapshot m;
+  m.version = "test";
+  m.kernel = "generic";
+  m.uptime = 1;
+  m.hashrate = HashRates();
+  m.hashes = 0;
+  m.foundShares = m.foundBlocks = 0;
+  m.accepted = m.rejected = m.stale = m.dropped = m.errors = 0;
+  m.getwork = m.submit = m.workSwitch = hs;
+  MetricsServer server;
+  if (!server.start("127.0.0.1:0", [&m] { return m; })) {
+    printf("metrics: can't start the endpoint\n");
+    return 1;
+  }
+  const std::string base =
+      "http://127.0.0.1:" + std::to_string(server.port());
+  std::string text, json;
+  CURL *curl = testCurl(base + "/metrics", &text, nullptr);
+  auto t1 = std::chrono::steady_clock::now();
+  CURLcode res = curl_easy_perform(curl);
+  std::chrono::duration<double, std::milli> took =
+      std::chrono::steady_clock::now() - t1;
+  curl_easy_setopt(curl, CURLOPT_URL, (base + "/metrics.json").c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json);
+  if (res == CURLE_OK) {
+    res = curl_easy_perform(curl);
+  }
+  curl_easy_cleanup(curl);
+  Json::Value parsed;
+  std::unique_ptr<Json::CharReader> reader(
+      Json::CharReaderBuilder().newCharReader());
+  bool jsonOk = reader->parse(json.data(), json.data() + json.size(),
+                              &parsed, nullptr) &&
+                parsed.isObject() && parsed["shares"].isObject();
+  bool textOk =
+      text.find("\naquaminer_hashrate ") != std::string::npos &&
+      text.find("aquaminer_work_switch_seconds_count ") != std::string::npos;
+  printf(
+      "metrics: /metrics %zu bytes in %4.4f ms, /metrics.json %zu bytes; "
+      "buckets %s, text %s, json %s\n",
+      text.size(), took.count(), json.size(), bucketsOk ? "ok" : "WRONG",
+      textOk ? "ok" : "WRONG", jsonOk ? "ok" : "WRONG");
+  return (res != CURLE_OK) + !bucketsOk + !textOk + !jsonOk;
+}
@@ -0,0 +1,58 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdio.h>  // for printf
+
+#include <vector>  // for vector
+
+#include "pool.hpp"  // for PoolChoice, choosePool
+#include "tests.hpp"
+
+// choosePool() as pools go down, come back, slow down and take turns
+unsigned long testPoolChoice() {
+  struct Case {
+    PoolChoice pools[3];
+    int active;
+    bool split, rotate;
+    int want;
+  };
+  const PoolChoice primary = {0, true, 0.9}, backup = {1, true, 0.9},
+                   down = {0, false, 0.9}, slow = {0, true, 0.2};
+  const Case cases[] = {
+      {{down, down, {1, false, 0.9}}, -1, false, false, -1},  // none up
+      {{primary, backup, backup}, -1, false, false, 0},       // start
+      {{down, backup, backup}, 0, false, false, 1},           // failover
+      {{primary, backup, backup}, 1, false, false, 0},        // failback
+      {{slow, primary, backup}, 0, false, false, 1},          // too slow
+      {{{0, true, 0.7}, primary, backup}, 0, false, false, 0},  // no flap
+      {{primary, primary, backup}, 0, true, true, 1},         // next slice
+      {{primary, primary, backup}, 1, true, true, 0},         // wraps
+      {{primary, primary, backup}, 1, true, false, 1},        // mid slice
+      {{primary, down, backup}, 1, true, false, 0},           // split over
+      {{primary, backup, backup}, 0, true, true, 0},          // alone
+  };
+  unsigned long wrong = 0;
+  for (const Case &c : cases) {
+    std::vector<PoolChoice> pools(c.pools, c.pools + 3);
+    if (choosePool(pools, c.active, c.split, c.rotate) != c.want) {
+      wrong++;
+    }
+  }
+  printf("pool choice: %zu scenarios, %lu wrong\n",
+         sizeof(cases) / sizeof(cases[0]), wrong);
+  return wrong;
+}
@@ -0,0 +1,109 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <curl/curl.h>  // for curl_easy_setopt, curl_easy_perform
+#include <stdio.h>      // for printf
+#include <string.h>     // for strcmp, strcpy
+
+#include <chrono>  // for steady_clock, duration
+#include <string>  // for string
+#include <thread>  // for thread
+
+#include "jsonscan.hpp"  // for GetworkJob, scanGetwork
+#include "miner.hpp"     // for submitwork
+#include "pool.hpp"      // for Pool, PoolSpec
+#include "stubpool.hpp"  // for StubPool
+#include "submit.hpp"    // for Share, SubmitResult
+#include "tests.hpp"
+
+#define GETWORK_BODY \
+  "{\"jsonrpc\":\"2.0\",\"method\":\"aqua_getWork\",\"params\":[],\"id\":42}"
+
+// Solo blocks against the stub as a node. The next template is asked for
+// as soon as a block is found, while the block is still being submitted:
+// wake() as Miner::minerThread does, then Pool::poll as Miner::poolThread
+// does. Every block must be accepted and every template must move on.
+unsigned long testSolo() {
+  const int lagMs = 30;  // node's time to import a block
+  const int numBlocks = 5;
+  StubPool stub;
+  if (!stub.start()) {
+    printf("solo: can't start the stub node\n");
+    return 1;
+  }
+  stub.setNode(lagMs);
+  PoolSpec spec = {stub.url(), 0, 1};
+  Pool node(spec, 0);
+  std::string body, ignored;  // submitwork reads its own replies
+  node.getworkcurl = testCurl(spec.url, &body, nullptr);
+  curl_easy_setopt(node.getworkcurl, CURLOPT_POSTFIELDS, GETWORK_BODY);
+  node.submitcurl = testCurl(spec.url, &ignored, nullptr);
+  auto fetch = [&](GetworkJob *job) {
+    body.clear();
+    return curl_easy_perform(node.getworkcurl) == CURLE_OK &&
+           scanGetwork(body.data(), body.size(), job);
+  };
+
+  GetworkJob job, next;
+  int accepted = 0, polls = 0;
+  double total = 0;
+  bool ok = fetch(&job);
+  for (int i = 0; ok && i < numBlocks; i++) {
+    Share share;
+    share.nonce = i;
+    strcpy(share.inputStr, job.input);
+    auto found = std::chrono::steady_clock::now();
+    node.wake();  // what minerThread does on a solo block
+    SubmitResult res = SUBMIT_FAILED;
+    std::thread submitter([&] {
+      res = submitwork(&share, node.submitcurl);
+      node.wake();
+    });
+    // poolThread's getwork loop until the template moves on. A new job
+    // ends the chase, as Miner::setWork does.
+    bool moved = false;
+    std::chrono::steady_clock::time_point arrived;
+    auto getwork = [&] {
+      if (!fetch(&next)) {
+        return false;
+      }
+      if (!moved && strcmp(next.input, job.input) != 0) {
+        arrived = std::chrono::steady_clock::now();
+        moved = true;
+        node.newJob();
+      }
+      return true;
+    };
+    while (!moved && node.chasing() && (ok = node.poll(getwork))) {
+      polls++;
+    }
+    std::chrono::duration<double, std::milli> took = arrived - found;
+    submitter.join();
+    ok = ok && moved;
+    accepted += res == SUBMIT_ACCEPTED;
+    total += took.count();
+    job = next;
+  }
+  ok = ok && accepted == numBlocks &&
+       stub.blocks() == static_cast<unsigned long>(numBlocks);
+  printf(
+      "solo: %d of %d blocks accepted, next template %4.4f ms after a block "
+      "was found (node takes %d ms, %4.1f polls per block)\n",
+      accepted, numBlocks, total / numBlocks, lagMs,
+      static_cast<double>(polls) / numBlocks);
+  return ok ? 0 : 1;
+}
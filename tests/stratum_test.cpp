@@ -0,0 +1,139 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <arpa/inet.h>           // for htonl, ntohs
+#include <jsoncpp/json/value.h>  // for Value
+#include <netinet/in.h>          // for sockaddr_in, INADDR_LOOPBACK
+#include <stdio.h>               // for printf
+#include <sys/socket.h>          // for socket, bind, accept, send, recv
+#include <unistd.h>              // for close
+
+#include <atomic>  // for atomic
+#include <chrono>  // for steady_clock, duration
+#include <string>  // for string
+#include <thread>  // for thread, sleep_for
+
+#include "stratum.hpp"   // for StratumClient
+#include "stubpool.hpp"  // for StubPool
+#include "submit.hpp"    // for SubmitResult
+#include "tests.hpp"
+
+namespace {
+
+// a pool that answers the subscribe with one endless line: the client has
+// to hang up instead of buffering it. True if it did.
+bool endlessLine() {
+  int lfd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  sockaddr *sa = reinterpret_cast<sockaddr *>(&addr);
+  if (lfd < 0 || bind(lfd, sa, sizeof(addr)) != 0 || listen(lfd, 1) != 0 ||
+      getsockname(lfd, sa, &len) != 0) {
+    close(lfd);
+    return false;
+  }
+  std::thread pool([lfd] {
+    int fd = accept(lfd, nullptr, nullptr);
+    const std::string junk(1024, 'x');
+    for (int i = 0; i < 1024; i++) {
+      if (send(fd, junk.data(), junk.size(), MSG_NOSIGNAL) <= 0) {
+        break;  // the client hung up
+      }
+    }
+    // stay up until it does, so a hang up can't be mistaken for the cap
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {
+    }
+    close(fd);
+  });
+  StratumClient client;
+  bool connected = client.connect(
+      "stratum+tcp://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)),
+      "aquaminer-tests");
+  for (int i = 0; i < 50 && client.connected(); i++) {
+    Json::Value params;
+    client.nextJob(&params, 100);
+  }
+  bool hungUp = connected && !client.connected();
+  client.disconnect();
+  pool.join();
+  close(lfd);
+  return hungUp;
+}
+
+}  // namespace
+
+// The long poll test over stratum: how long after the stub pool has new
+// work it is pushed to the client, and a share's round trip. The client
+// keeps reading while it submits, like Miner::getworkThread does. A pool
+// that never ends its line gets hung up on.
+unsigned long testStratum() {
+  StubPool stub;
+  StratumClient client;
+  Json::Value job;
+  if (!stub.start() || !client.connect(stub.stratumUrl(), "aquaminer-tests") ||
+      !client.nextJob(&job, 1000)) {
+    printf("stratum: can't mine on the stub pool\n");
+    return 1;
+  }
+
+  const std::string input = "0x" + std::string(63, '0') + "3";
+  std::atomic<bool> done(false);
+  std::chrono::steady_clock::time_point seen;
+  bool gotWork = false;
+  std::thread reader([&] {
+    // give up after a few seconds, or if the stub hangs up
+    for (int i = 0; i < 50 && !done && client.connected(); i++) {
+      Json::Value params;
+      if (client.nextJob(&params, 100) && params[0].asString() == input) {
+        seen = std::chrono::steady_clock::now();
+        gotWork = true;
+        done = true;
+      }
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto published = std::chrono::steady_clock::now();
+  stub.setWork(input);
+  reader.join();
+  std::chrono::duration<double, std::milli> latency = seen - published;
+
+  done = false;
+  reader = std::thread([&] {
+    Json::Value params;
+    while (!done && client.connected()) {
+      client.nextJob(&params, 100);
+    }
+  });
+  auto sent = std::chrono::steady_clock::now();
+  SubmitResult res = client.submit("0000000000000000", input.c_str(), 1000);
+  std::chrono::duration<double, std::milli> rtt =
+      std::chrono::steady_clock::now() - sent;
+  done = true;
+  reader.join();
+  bool hungUp = endlessLine();
+  unsigned long bad = !gotWork + (res != SUBMIT_ACCEPTED) + !hungUp;
+  printf(
+      "stratum: new work %s %4.4f ms after the pool had it, share %s in "
+      "%4.4f ms, endless line %s\n",
+      gotWork ? "seen" : "NOT seen", latency.count(),
+      res == SUBMIT_ACCEPTED ? "accepted" : "NOT accepted", rtt.count(),
+      hungUp ? "hung up on" : "NOT hung up on");
+  return bad;
+}
@@ -0,0 +1,294 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "stubpool.hpp"
+
+#include <arpa/inet.h>   // for htonl, htons
+#include <netinet/in.h>  // for sockaddr_in
+#include <poll.h>        // for poll
+#include <string.h>      // for memset, strstr
+#include <sys/socket.h>  // for socket, bind, listen, accept
+#include <unistd.h>      // for close, read, write
+
+#include <chrono>  // for seconds
+#include <cstdio>  // for snprintf
+#include <cstdlib>  // for strtol, strtoul
+
+#define STUB_LONGPOLL_PATH "/lp"
+
+StubPool::StubPool()
+    : listenfd(-1),
+      port(0),
+      running(false),
+      work("0x" + std::string(63, '0') + "1"),
+      generation(0),
+      nodeLagMs(-1),
+      numBlocks(0),
+      blockPending(false) {}
+
+StubPool::~StubPool() { stop(); }
+
+bool StubPool::start() {
+  listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenfd < 0) {
+    return false;
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;  // any free port
+  socklen_t len = sizeof(addr);
+  if (bind(listenfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listenfd, 8) != 0 ||
+      getsockname(listenfd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+    close(listenfd);
+    listenfd = -1;
+    return false;
+  }
+  port = ntohs(addr.sin_port);
+  running = true;
+  acceptor = std::thread(&StubPool::acceptLoop, this);
+  return true;
+}
+
+void StubPool::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    generation++;
+  }
+  workcv.notify_all();
+  acceptor.join();
+  for (auto &t : conns) {
+    t.join();
+  }
+  conns.clear();
+  close(listenfd);
+  listenfd = -1;
+}
+
+std::string StubPool::url() const {
+  return "http://127.0.0.1:" + std::to_string(port) + "/";
+}
+
+std::string StubPool::stratumUrl() const {
+  return "stratum+tcp://127.0.0.1:" + std::to_string(port);
+}
+
+void StubPool::setWork(const std::string &input) {
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    work = input;
+    generation++;
+  }
+  workcv.notify_all();
+  std::string notify =
+      "{\"id\":null,\"method\":\"mining.notify\",\"params\":" +
+      workParams() + "}\n";
+  std::lock_guard<std::mutex> lock(mu);
+  for (int fd : subscribers) {
+    reply(fd, notify);
+  }
+}
+
+void StubPool::setNode(int lagMs) {
+  std::lock_guard<std::mutex> lock(mu);
+  nodeLagMs = lagMs;
+}
+
+unsigned long StubPool::blocks() {
+  std::lock_guard<std::mutex> lock(mu);
+  return numBlocks;
+}
+
+// the block after the one just mined is due, counting up from the input
+// (holding mu)
+void StubPool::nextBlock() {
+  if (!blockPending || std::chrono::steady_clock::now() < blockDue) {
+    return;
+  }
+  blockPending = false;
+  for (size_t i = work.size() - 1; i > 1; i--) {
+    char &c = work[i];
+    c = c == '9' ? 'a' : c == 'f' ? '0' : static_cast<char>(c + 1);
+    if (c != '0') {
+      break;
+    }
+  }
+  generation++;
+  workcv.notify_all();
+}
+
+// the job, same for getwork and stratum. The seed hash ends in the aquahash
+// version, target is 2^224-1
+std::string StubPool::workParams() {
+  const std::string seed = "0x" + std::string(63, '0') + "2";
+  const std::string target = "0x00000000" + std::string(56, 'f');
+  std::lock_guard<std::mutex> lock(mu);
+  return "[\"" + work + "\",\"" + seed + "\",\"" + target +
+         "\",\"0x100000000\"]";
+}
+
+bool StubPool::reply(int fd, const std::string &line) {
+  return write(fd, line.data(), line.size()) ==
+         static_cast<ssize_t>(line.size());
+}
+
+void StubPool::acceptLoop() {
+  while (running) {
+    pollfd p = {listenfd, POLLIN, 0};
+    if (poll(&p, 1, 100) <= 0) {
+      continue;
+    }
+    int fd = accept(listenfd, nullptr, nullptr);
+    if (fd >= 0) {
+      conns.push_back(std::thread(&StubPool::serve, this, fd));
+    }
+  }
+}
+
+// one keep-alive connection, one request at a time
+void StubPool::serve(int fd) {
+  std::string in;
+  char buf[4096];
+  while (running) {
+    size_t end = in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 100) <= 0) {
+        continue;
+      }
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      in.append(buf, n);
+      if (in[0] == '{') {
+        serveStratum(fd, in);
+        return;
+      }
+      continue;
+    }
+    size_t bodyLen = 0;
+    const char *cl = strstr(in.c_str(), "Content-Length:");
+    if (cl != nullptr && static_cast<size_t>(cl - in.c_str()) < end) {
+      bodyLen = strtoul(cl + 15, nullptr, 10);
+    }
+    if (in.size() < end + 4 + bodyLen) {
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      in.append(buf, n);
+      continue;
+    }
+    const char lp[] = "POST " STUB_LONGPOLL_PATH " ";
+    bool longPoll = in.compare(0, sizeof(lp) - 1, lp) == 0;
+    bool submit = in.find("aqua_submitWork", end) != std::string::npos;
+    in.erase(0, end + 4 + bodyLen);
+    std::string result;
+    if (submit) {
+      result = "true";
+      std::lock_guard<std::mutex> lock(mu);
+      if (nodeLagMs >= 0) {
+        numBlocks++;
+        blockPending = true;
+        blockDue = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(nodeLagMs);
+        nextBlock();
+      }
+    }
+    if (longPoll) {
+      // hold the request until there is new work
+      std::unique_lock<std::mutex> lock(mu);
+      unsigned long seen = generation;
+      workcv.wait_for(lock, std::chrono::seconds(30),
+                      [&] { return generation != seen; });
+    }
+    if (!submit) {
+      {
+        std::lock_guard<std::mutex> lock(mu);
+        nextBlock();
+      }
+      result = workParams();
+    }
+    std::string body =
+        "{\"jsonrpc\":\"2.0\",\"id\":42,\"result\":" + result + "}";
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+             "X-Long-Polling: " STUB_LONGPOLL_PATH
+             "\r\nContent-Length: %zu\r\n\r\n",
+             body.size());
+    std::string out = head + body;
+    if (write(fd, out.data(), out.size()) != static_cast<ssize_t>(out.size())) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+// one stratum connection: subscribe gets the current job, submits are all
+// accepted. Writes hold mu, setWork() pushes jobs from another thread.
+void StubPool::serveStratum(int fd, std::string in) {
+  char buf[4096];
+  while (running) {
+    size_t eol = in.find('\n');
+    if (eol == std::string::npos) {
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 100) <= 0) {
+        continue;
+      }
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      in.append(buf, n);
+      continue;
+    }
+    std::string line = in.substr(0, eol);
+    in.erase(0, eol + 1);
+    long id = 0;
+    const char *idp = strstr(line.c_str(), "\"id\":");
+    if (idp != nullptr) {
+      id = strtol(idp + 5, nullptr, 10);
+    }
+    std::string answer =
+        "{\"id\":" + std::to_string(id) + ",\"result\":true,\"error\":null}\n";
+    if (line.find("\"mining.subscribe\"") != std::string::npos) {
+      answer += "{\"id\":null,\"method\":\"mining.notify\",\"params\":" +
+                workParams() + "}\n";
+      std::lock_guard<std::mutex> lock(mu);
+      subscribers.push_back(fd);
+    }
+    std::lock_guard<std::mutex> lock(mu);
+    if (!reply(fd, answer)) {
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mu);
+  for (size_t i = 0; i < subscribers.size(); i++) {
+    if (subscribers[i] == fd) {
+      subscribers.erase(subscribers.begin() + i);
+      break;
+    }
+  }
+  close(fd);
+}
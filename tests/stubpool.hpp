@@ -0,0 +1,76 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_STUBPOOL_H
+#define M_STUBPOOL_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// StubPool is a tiny loopback pool for the tests. It answers aqua_getWork on
+// any path, advertises long polling at /lp with an X-Long-Polling header,
+// and holds /lp requests until setWork() is called. Connections that open
+// with a JSON line instead of an HTTP request get stratum: setWork() is
+// pushed to them as mining.notify, every mining.submit is accepted.
+// Every aqua_submitWork is accepted too; as a node (setNode()) each one is
+// a block and the work moves on to the next one.
+class StubPool {
+ public:
+  StubPool();
+  ~StubPool();
+  // listen on 127.0.0.1 at a free port, false if that fails
+  bool start();
+  void stop();
+  std::string url() const;
+  std::string stratumUrl() const;
+  // new work, releases every waiting long poll
+  void setWork(const std::string &input);
+  // act like a solo node: a submit mines a block, getwork has the next
+  // template `lagMs` later
+  void setNode(int lagMs);
+  unsigned long blocks();  // submits accepted as a node
+
+ private:
+  StubPool(const StubPool &);
+  StubPool &operator=(const StubPool &);
+  void acceptLoop();
+  void serve(int fd);
+  void serveStratum(int fd, std::string in);
+  std::string workParams();
+  void nextBlock();
+  bool reply(int fd, const std::string &line);
+  int listenfd;
+  int port;
+  std::atomic<bool> running;
+  std::thread acceptor;
+  std::vector<std::thread> conns;
+  std::mutex mu;
+  std::condition_variable workcv;
+  std::string work;
+  std::vector<int> subscribers;  // stratum connections, for setWork()
+  unsigned long generation;
+  int nodeLagMs;                                   // -1 if not a node
+  unsigned long numBlocks;                         // same
+  bool blockPending;                               // next template not out yet
+  std::chrono::steady_clock::time_point blockDue;  // when it is
+};
+
+#endif  // M_STUBPOOL_H
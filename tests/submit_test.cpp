@@ -0,0 +1,104 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <stdint.h>  // for uint64_t
+#include <stdio.h>   // for printf
+
+#include <algorithm>  // for max
+#include <chrono>     // for steady_clock, seconds
+#include <thread>     // for thread
+#include <vector>     // for vector
+
+#include "submit.hpp"  // for Share, ShareQueue
+#include "tests.hpp"
+
+// Shares pushed from a thread per cpu, every 64th a block, while this
+// thread pops them: none may come out lost, twice, out of order in its
+// lane, or behind a share queued after it. Then a block queued behind a
+// backlog of shares must come out first.
+unsigned long testShareQueue() {
+  const unsigned long n = 100000;
+  const int threads =
+      std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+  ShareQueue q;
+  unsigned long wrong = 0;
+  unsigned long perThread = n / threads;
+  std::vector<std::thread> pushers;
+  for (int t = 0; t < threads; t++) {
+    pushers.emplace_back([&q, t, perThread] {
+      for (unsigned long i = 0; i < perThread; i++) {
+        Share *s = new Share;
+        s->nonce = (static_cast<uint64_t>(t) << 32) | i;
+        s->block = i % 64 == 0;
+        q.push(s);
+      }
+    });
+  }
+  // per thread and lane, shares must come out in the order pushed
+  std::vector<long> last(threads * 2, -1);
+  std::vector<char> seen(threads * perThread, 0);
+  unsigned long popped = 0;
+  auto lastPop = std::chrono::steady_clock::now();
+  while (popped < threads * perThread) {
+    Share *s = q.wait(100);
+    if (s == nullptr) {
+      // a push caught half done shows up on a later pop, give up only
+      // once nothing has come for a while
+      if (std::chrono::steady_clock::now() - lastPop >
+          std::chrono::seconds(2)) {
+        break;
+      }
+      continue;
+    }
+    lastPop = std::chrono::steady_clock::now();
+    int t = static_cast<int>(s->nonce >> 32);
+    long i = static_cast<long>(s->nonce & 0xffffffff);
+    long &prev = last[t * 2 + (s->block ? 1 : 0)];
+    if (i <= prev || seen[t * perThread + i]) {
+      wrong++;
+    }
+    prev = i;
+    seen[t * perThread + i] = 1;
+    popped++;
+    delete s;
+  }
+  for (std::thread &t : pushers) {
+    t.join();
+  }
+  wrong += threads * perThread - popped;
+
+  // a block found behind a backlog of shares goes first
+  for (int i = 0; i < 100; i++) {
+    Share *s = new Share;
+    s->block = i % 10 == 9;  // 10 blocks, each behind 9 shares
+    q.push(s);
+  }
+  for (int i = 0; i < 100; i++) {
+    Share *s = q.pop();
+    if (s == nullptr) {
+      wrong++;
+      continue;
+    }
+    if (s->block != (i < 10)) {
+      wrong++;
+    }
+    delete s;
+  }
+  printf("share queue: %lu shares from %d threads, %lu wrong\n", n, threads,
+         wrong);
+  return wrong;
+}
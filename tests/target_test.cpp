@@ -0,0 +1,165 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gmp.h>     // for mp_set_memory_functions, mpz_cmp
+#include <stdint.h>  // for uint8_t, uint64_t
+#include <stdio.h>   // for printf, snprintf
+#include <string.h>  // for memcpy
+
+#include <atomic>  // for atomic
+#include <chrono>  // for steady_clock, high_resolution_clock
+#include <memory>  // for shared_ptr
+#include <random>  // for mt19937_64
+#include <vector>  // for vector
+
+#include "aqua.hpp"    // for hashMeetsTarget, mpz_fromBytesNoInit
+#include "target.hpp"  // for JobTargets, mpz_maxBest
+#include "tests.hpp"
+#include "work.hpp"  // for Work, WorkChannel
+
+namespace {
+
+// GMP allocations, counted on the way through to the functions GMP was
+// already using, so blocks from before and after the hook mix freely. No
+// other thread is running while they are hooked.
+std::atomic<long> gmpBlocks(0);
+void *(*gmpAlloc)(size_t);
+void *(*gmpRealloc)(void *, size_t, size_t);
+void (*gmpFree)(void *, size_t);
+
+void *countedAlloc(size_t size) {
+  gmpBlocks++;
+  return gmpAlloc(size);
+}
+
+void *countedRealloc(void *p, size_t oldSize, size_t size) {
+  return gmpRealloc(p, oldSize, size);
+}
+
+void countedFree(void *p, size_t size) {
+  gmpBlocks--;
+  gmpFree(p, size);
+}
+
+}  // namespace
+
+// hashMeetsTarget against import and mpz_cmp, the way the miner loop used
+// to compare, on random hash/target pairs that sit right at the target
+unsigned long testTargetCompare() {
+  const unsigned long n = 1000000;
+  std::mt19937_64 prng(n);
+  std::vector<uint8_t> hashes(n * 32);
+  std::vector<uint64_t> targets(n * 4);
+  std::vector<char> fast(n), slow(n);
+  for (unsigned long i = 0; i < n; i++) {
+    uint64_t *t = &targets[i * 4];
+    for (int w = 0; w < 4; w++) {
+      t[w] = prng();
+    }
+    // make the hash share 0..4 leading words with the target, then land
+    // just above or below it in the next one
+    int same = prng() % 5;
+    for (int w = 0; w < 4; w++) {
+      uint64_t h = t[w];
+      if (w == same) {
+        h += (prng() & 1) ? 1 : -1;
+      } else if (w > same) {
+        h = prng();
+      }
+      h = __builtin_bswap64(h);
+      memcpy(&hashes[i * 32 + w * 8], &h, 8);
+    }
+  }
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (unsigned long i = 0; i < n; i++) {
+    fast[i] = hashMeetsTarget(&hashes[i * 32], &targets[i * 4]);
+  }
+  std::chrono::duration<double> fastDur =
+      std::chrono::high_resolution_clock::now() - t1;
+
+  // what the miner loop did per hash: import the hash and mpz_cmp it
+  std::vector<__mpz_struct> mpz_targets(n);
+  for (unsigned long i = 0; i < n; i++) {
+    mpz_init(&mpz_targets[i]);
+    mpz_import(&mpz_targets[i], 4, 1, sizeof(uint64_t), 0, 0,
+               &targets[i * 4]);
+  }
+  mpz_t mpz_hash;
+  mpz_init(mpz_hash);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  for (unsigned long i = 0; i < n; i++) {
+    mpz_fromBytesNoInit(&hashes[i * 32], 32, mpz_hash);
+    slow[i] = mpz_cmp(mpz_hash, &mpz_targets[i]) <= 0;
+  }
+  std::chrono::duration<double> gmpDur =
+      std::chrono::high_resolution_clock::now() - t2;
+  mpz_clear(mpz_hash);
+  for (unsigned long i = 0; i < n; i++) {
+    mpz_clear(&mpz_targets[i]);
+  }
+
+  unsigned long mismatches = 0;
+  for (unsigned long i = 0; i < n; i++) {
+    if (fast[i] != slow[i]) mismatches++;
+  }
+  printf(
+      "target compare: %lu pairs, %lu mismatches; fixed %4.4f M/sec, gmp "
+      "%4.4f M/sec\n",
+      n, mismatches, n / fastDur.count() / 1e6, n / gmpDur.count() / 1e6);
+  return mismatches;
+}
+
+// Simulated jobs through JobTargets, Work snapshots and a WorkChannel, with
+// share and network difficulty wandering like vardiff and retargets. Every
+// GMP block allocated on the way must be freed again. Anything else left
+// behind is LeakSanitizer's to find at exit; the resident set says little
+// under ASan's quarantine, so it isn't measured here.
+unsigned long testTargetSoak() {
+  const unsigned long n = 1000000;
+  mpz_maxBest();  // allocated for good, before counting starts
+  mp_get_memory_functions(&gmpAlloc, &gmpRealloc, &gmpFree);
+  mp_set_memory_functions(countedAlloc, countedRealloc, countedFree);
+  long before = gmpBlocks.load();
+  auto start = std::chrono::steady_clock::now();
+  {
+    JobTargets targets;
+    targets.setMinShareDifficulty(1ULL << 30);
+    WorkChannel channel;
+    static const char digits[] = "123456789abcdef";
+    char target[80], difficulty[40];
+    for (unsigned long i = 0; i < n; i++) {
+      int zeros = 1 + static_cast<int>(i % 12);
+      snprintf(target, sizeof(target), "0x%.*s%c%.*s", zeros,
+               "000000000000", digits[i % 15], 63 - zeros,
+               "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+               "ffff");
+      snprintf(difficulty, sizeof(difficulty), "0x%llx",
+               (1ULL << (4 * zeros + 2 + i % 8)) + i);
+      std::shared_ptr<Work> work(new Work);
+      targets.compute(target, difficulty, work->target, work->targetWords,
+                      work->blockWords, &work->difficulty);
+      channel.publish(work);  // and the job before it is freed
+    }
+  }
+  std::chrono::duration<double> dur = std::chrono::steady_clock::now() - start;
+  long leaked = gmpBlocks.load() - before;
+  mp_set_memory_functions(gmpAlloc, gmpRealloc, gmpFree);
+  printf("target soak: %lu jobs at %4.1f k/sec, %ld GMP blocks leaked\n", n,
+         n / dur.count() / 1000, leaked);
+  return leaked == 0 ? 0 : 1;
+}
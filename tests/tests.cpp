@@ -0,0 +1,105 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <curl/curl.h>  // for curl_easy_init, curl_easy_setopt
+#include <stdio.h>      // for printf, fprintf
+#include <string.h>     // for strcmp
+
+#include <string>  // for string
+
+#include "tests.hpp"
+
+namespace {
+
+struct Test {
+  const char *name;
+  unsigned long (*run)();
+};
+
+// in the order they run, cheap ones first
+const Test tests[] = {
+    {"pool_choice", testPoolChoice},
+    {"long_poll", testLongPoll},
+    {"metrics", testMetrics},
+    {"solo", testSolo},
+    {"stratum", testStratum},
+    {"target_compare", testTargetCompare},
+    {"hex_codec", testHexCodec},
+    {"engine", testEngine},
+    {"hashrate_meter", testHashrateMeter},
+    {"share_queue", testShareQueue},
+    {"work_channel", testWorkChannel},
+    {"json_scan", testJsonScan},
+    {"target_soak", testTargetSoak},
+};
+
+std::size_t appendCallback(const char *in, std::size_t size, std::size_t num,
+                           std::string *out) {
+  out->append(in, size * num);
+  return size * num;
+}
+
+bool known(const char *name) {
+  for (const Test &t : tests) {
+    if (strcmp(t.name, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+CURL *testCurl(const std::string &url, std::string *body,
+               std::string *headers) {
+  CURL *curl = curl_easy_init();
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+  if (headers != nullptr) {
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, appendCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, headers);
+  }
+  return curl;
+}
+
+// aquaminer-tests [name ...] runs the named tests, or all of them. Exits 1
+// if a check failed, 2 for a test it doesn't know.
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!known(argv[i])) {
+      fprintf(stderr, "no test named %s\n", argv[i]);
+      return 2;
+    }
+  }
+  unsigned long failed = 0;
+  for (const Test &t : tests) {
+    bool wanted = argc == 1;
+    for (int i = 1; i < argc; i++) {
+      wanted = wanted || strcmp(argv[i], t.name) == 0;
+    }
+    if (!wanted) {
+      continue;
+    }
+    unsigned long wrong = t.run();
+    printf("%s %s\n", wrong == 0 ? "ok" : "FAIL", t.name);
+    failed += wrong;
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef M_TESTS_H
+#define M_TESTS_H
+#include <curl/curl.h>
+
+#include <string>
+
+// Each test prints a line saying what it checked, and what it timed, and
+// returns how many of its checks failed. tests.cpp runs them.
+
+// a curl handle on `url` for the tests that talk HTTP. Replies are appended
+// to `body`, and their headers to `headers` unless it is nullptr.
+CURL *testCurl(const std::string &url, std::string *body,
+               std::string *headers);
+
+// longpoll_test.cpp
+unsigned long testLongPoll();
+
+// metrics_test.cpp
+unsigned long testMetrics();
+
+// pool_test.cpp
+unsigned long testPoolChoice();
+
+// solo_test.cpp
+unsigned long testSolo();
+
+// stratum_test.cpp
+unsigned long testStratum();
+
+// submit_test.cpp
+unsigned long testShareQueue();
+
+// target_test.cpp
+unsigned long testTargetCompare();
+unsigned long testTargetSoak();
+
+// work_test.cpp
+unsigned long testWorkChannel();
+
+// engine_test.cpp
+unsigned long testEngine();
+
+// hashrate_test.cpp
+unsigned long testHashrateMeter();
+
+// hexcodec_test.cpp
+unsigned long testHexCodec();
+
+// jsonscan_test.cpp
+unsigned long testJsonScan();
+
+#endif  // M_TESTS_H
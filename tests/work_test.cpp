@@ -0,0 +1,98 @@
+// Aquachain CPU Miner
+
+// Copyright (C) 2020 aerth <aerth@riseup.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <gmp.h>     // for mpz_set_ui, mpz_cmp
+#include <stdio.h>   // for printf, snprintf
+#include <string.h>  // for memcmp, memset, strcmp
+
+#include <atomic>  // for atomic
+#include <memory>  // for shared_ptr
+#include <string>  // for to_string
+#include <thread>  // for thread
+
+#include "tests.hpp"
+#include "work.hpp"  // for Work, WorkChannel
+
+namespace {
+// every field of job i carries i, so a mix of two jobs shows
+void fakeWork(uint64_t i, Work *w) {
+  memset(w->input, static_cast<int>(i & 0xff), sizeof(w->input));
+  snprintf(w->inputStr, sizeof(w->inputStr), "0x%064llx",
+           static_cast<unsigned long long>(i));
+  w->version = static_cast<char>(i & 0xff);
+  for (int k = 0; k < 4; k++) {
+    w->targetWords[k] = i;
+    w->blockWords[k] = i;
+  }
+  mpz_set_ui(w->target, i);
+  w->difficulty = std::to_string(i);
+  w->pool = static_cast<int>(i);
+}
+
+bool sameWork(const Work &a, const Work &b) {
+  return 0 == memcmp(a.input, b.input, sizeof(a.input)) &&
+         0 == strcmp(a.inputStr, b.inputStr) && a.version == b.version &&
+         0 == memcmp(a.targetWords, b.targetWords, sizeof(a.targetWords)) &&
+         0 == memcmp(a.blockWords, b.blockWords, sizeof(a.blockWords)) &&
+         0 == mpz_cmp(a.target, b.target) && a.difficulty == b.difficulty &&
+         a.pool == b.pool;
+}
+}  // namespace
+
+// Publish jobs from one thread while another reads them back. Every read
+// must be one whole job, never older than one already seen, and every job
+// must be freed once the last reader lets go of it.
+unsigned long testWorkChannel() {
+  const unsigned long n = 1000000;
+  std::atomic<unsigned long> freed(0);
+  unsigned long wrong = 0, reads = 0;
+  {
+    WorkChannel channel;
+    std::atomic<bool> done(false);
+    std::thread reader([&] {
+      Work want;
+      uint64_t seen = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        if (channel.epoch() == seen) {
+          continue;
+        }
+        std::shared_ptr<const Work> w = channel.read();
+        fakeWork(w->epoch, &want);
+        if (!sameWork(*w, want) || w->epoch < seen) {
+          wrong++;
+        }
+        seen = w->epoch;
+        reads++;
+      }
+    });
+    for (unsigned long i = 1; i <= n; i++) {
+      std::shared_ptr<Work> w(new Work, [&freed](Work *old) {
+        freed++;
+        delete old;
+      });
+      fakeWork(i, w.get());
+      channel.publish(w);
+    }
+    done = true;
+    reader.join();
+  }
+  // every job is freed once nobody holds it, the last with the channel
+  unsigned long leaked = n - freed;
+  printf("work channel: %lu publishes, %lu reads, %lu wrong, %lu leaked\n", n,
+         reads, wrong, leaked);
+  return wrong + leaked;
+}